@@ -64,11 +64,12 @@
 #define configSUPPORT_DYNAMIC_ALLOCATION         1
 #define configUSE_IDLE_HOOK                      0
 #define configUSE_TICK_HOOK                      0
+#define configUSE_MALLOC_FAILED_HOOK             1
 #define configCPU_CLOCK_HZ                       ( SystemCoreClock )
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 56 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                    ((size_t)6 * 1024)
+#define configTOTAL_HEAP_SIZE                    ((size_t)10 * 1024)
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configUSE_TRACE_FACILITY                 1
 #define configUSE_16_BIT_TICKS                   0
@@ -94,7 +95,11 @@
 #define configTIMER_TASK_STACK_DEPTH             256
 
 /* The following flag must be enabled only when using newlib */
+#if defined(FMT_REPLACE_PRINTF) && (FMT_REPLACE_PRINTF != 0)
+#define configUSE_NEWLIB_REENTRANT          0 /* printf comes from fmt.c, no task needs a struct _reent */
+#else
 #define configUSE_NEWLIB_REENTRANT          1
+#endif
 
 /* CMSIS-RTOS V2 flags */
 #define configUSE_OS2_THREAD_SUSPEND_RESUME  1
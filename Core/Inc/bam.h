@@ -0,0 +1,47 @@
+/*
+ * bam.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_BAM_H_
+#define INC_BAM_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+
+/*
+ * Bit-angle modulation on plain GPIOC outputs, driven by TIM6. A frame is
+ * split into BAM_BITS slots whose lengths double (1, 2, 4 ... 128 ticks); in
+ * slot k every driven pin is on if bit k of its level is set. That is 8 timer
+ * interrupts per frame instead of 256 for software PWM.
+ *
+ * The per-slot BSRR words for all pins are kept ready, so the interrupt only
+ * stores one word and reloads ARR. Its cost does not depend on the number of
+ * pins (any of the 16 GPIOC pins, each its own level).
+ *
+ * bam_set() and bam_release() update the words in a short critical section,
+ * safe from tasks and from interrupts (the LED arbiter calls them). A new
+ * level starts with the next frame, so no frame mixes two levels of a pin.
+ * A released pin is dropped from both sets of words at once and keeps the
+ * state it had; the caller writes the state it wants right after. The pins
+ * must already be outputs, BAM does not touch MODER.
+ */
+
+#define BAM_BITS 8U
+
+#ifndef BAM_TICK_US
+#define BAM_TICK_US 16U // Shortest slot, frame = 255 ticks = 4.08 ms (245 Hz)
+#endif
+
+#define BAM_BRIGHTNESS_MAX 999U // Same scale as set_pwm_brightness()
+
+void bam_init(void);
+void bam_set(uint16_t pin_mask, uint16_t brightness);
+void bam_release(uint16_t pin_mask);
+uint16_t bam_driven(void);
+
+#endif /* INC_BAM_H_ */
@@ -17,11 +17,94 @@
 #include "stm32g071xx.h"
 #include "led.h"
 #include "pwm.h"
+#include "log.h"
+#include "isr_log.h"
+
+/*
+ * Button debounce and gestures, driven by interrupts only.
+ *
+ * The first edge on a button's EXTI line masks the line and arms a one-shot
+ * timer (TIMER_FOR_BUTTON) for the button's debounce time; the bounce that
+ * follows is not seen at all. When the timer fires, the pin is sampled: a
+ * level that differs from the last stable one is a press or a release, the
+ * same level was a glitch. The line is then unmasked again.
+ *
+ * Presses and releases drive the gesture of each button, whose deadlines
+ * (long press, hold repeat, end of the double-click window) share the same
+ * timer: it is always armed for the earliest deadline of all buttons.
+ *
+ *   BUTTON_CLICK         short press, reported when the double-click window
+ *                        has passed (at release when double_click_ms is 0)
+ *   BUTTON_DOUBLE_CLICK  second short press within double_click_ms
+ *   BUTTON_LONG_PRESS    held for long_press_ms
+ *   BUTTON_REPEAT        every repeat_ms while still held, count 1, 2, ...
+ *   BUTTON_HOLD_END      released after a long press
+ *
+ * Events go to a queue that the application task blocks on
+ * (button_get_event()). Each interrupt handles every button at most once, so
+ * its cost is bounded by BUTTON_MAX. Lines 4..15 only, they share
+ * EXTI4_15_IRQHandler.
+ */
+
+#ifndef BUTTON_MAX
+#define BUTTON_MAX 4U
+#endif
+
+#ifndef BUTTON_EVENT_QUEUE_LEN
+#define BUTTON_EVENT_QUEUE_LEN 8U
+#endif
+
+#define BUTTON_TIMER_HZ 10000U // One-shot timer resolution 100 us, longest arm 6.5 s
+
+typedef struct
+{
+	const char *name;
+	GPIO_TypeDef *port;
+	uint8_t pin;              // 4..15, also the EXTI line
+	uint8_t active_low;       // 1 = pressed reads 0, the pin gets a pull-up
+	uint16_t debounce_ms;     // 1..100
+	uint16_t double_click_ms; // 0 = no double-click, a click is reported at release
+	uint16_t long_press_ms;   // 0 = no long press, every press is a click
+	uint16_t repeat_ms;       // 0 = no hold repeat
+} button_config; // Referenced, not copied: keep it in static storage
+
+typedef enum
+{
+	BUTTON_CLICK = 0,
+	BUTTON_DOUBLE_CLICK,
+	BUTTON_LONG_PRESS,
+	BUTTON_REPEAT,
+	BUTTON_HOLD_END,
+	BUTTON_EVENT_COUNT
+} button_event_type;
+
+typedef struct
+{
+	uint8_t button;  // Index returned by button_add()
+	uint8_t type;    // button_event_type
+	uint16_t count;  // Repeat number, clicks for the click events
+	uint32_t time_us; // timestamp_now() of the first edge that decided the event, or of the deadline for a long press or repeat
+	uint32_t sent_us; // timestamp_now() when the interrupt queued it
+} button_event;
+
+typedef struct
+{
+	uint32_t edges;       // Unmasked edges, each starts a debounce
+	uint32_t glitches;    // Debounces that found the stable level unchanged
+	uint32_t events[BUTTON_EVENT_COUNT];
+	uint32_t dropped;     // Events lost to a full queue
+	uint32_t timer_irqs;
+} ButtonProfiler;
 
 extern TaskHandle_t xButtonTaskHandle;
+extern ButtonProfiler ButtonStats;
+extern const char *const button_event_names[BUTTON_EVENT_COUNT];
 
-void button_gpio_init(void);
+void button_init(void);
+int button_add(const button_config *config);
+const button_config *button_get(uint8_t button);
 void button_enable_interrupt(void);
+BaseType_t button_get_event(button_event *event, TickType_t timeout);
 uint8_t is_button_pressed(void);
 
 
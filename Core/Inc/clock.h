@@ -0,0 +1,76 @@
+/*
+ * clock.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_CLOCK_H_
+#define INC_CLOCK_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "stm32g071xx.h"
+
+/*
+ * System clock profiles and the runtime switch between them.
+ *
+ *   hsi16  16 MHz HSI, no PLL, 0 flash wait states (SystemClock_Config())
+ *   pll64  64 MHz from the PLL on HSI (16 / 1 * 8 / 2), 2 wait states,
+ *          prefetch and instruction cache on
+ *   lprun  2 MHz HSI / 8 with the regulator in low-power run mode
+ *
+ * clock_set_profile() calls every registered driver with CLOCK_PREPARE while
+ * the scheduler still runs, then suspends the scheduler, stops SysTick, calls
+ * the drivers with CLOCK_BEFORE, reprograms RCC and flash, reloads
+ * SysTick for configTICK_RATE_HZ at the new SystemCoreClock, then calls the
+ * drivers with CLOCK_AFTER so they re-derive their timings (UART BRR, timer
+ * prescalers, the PWM period) from timer_clock_hz(). Interrupts stay enabled
+ * throughout: the HAL timeouts run on TIM17, which HAL_RCC_ClockConfig()
+ * reprograms itself. The kernel tick loses at most the tick in progress.
+ *
+ * Task context only, and not from a notifier.
+ */
+
+typedef enum
+{
+	CLOCK_PROFILE_HSI16 = 0,
+	CLOCK_PROFILE_PLL64,
+	CLOCK_PROFILE_LPRUN,
+	CLOCK_PROFILE_COUNT
+} clock_profile;
+
+typedef enum
+{
+	CLOCK_PREPARE = 0, // Scheduler still running, may block to finish long work
+	CLOCK_BEFORE,      // Scheduler suspended, old clock still running, finish or pause what depends on it
+	CLOCK_AFTER        // New clock running, SystemCoreClock updated
+} clock_event;
+
+typedef void (*clock_notify)(clock_event event);
+
+#ifndef CLOCK_MAX_NOTIFY
+#define CLOCK_MAX_NOTIFY 8U
+#endif
+
+// Profile main() switches to once the drivers are up
+#ifndef CLOCK_DEFAULT_PROFILE
+#define CLOCK_DEFAULT_PROFILE CLOCK_PROFILE_HSI16
+#endif
+
+typedef struct
+{
+	uint32_t switches;
+	uint32_t failures;      // RCC refused the new setting, back on hsi16
+	uint32_t switch_us;     // Last switch, notifiers included
+	uint32_t hz;            // SystemCoreClock after the last switch
+} ClockProfiler;
+
+extern ClockProfiler ClockStats;
+extern const char *const clock_profile_names[CLOCK_PROFILE_COUNT];
+
+int clock_register(clock_notify notify);
+int clock_set_profile(clock_profile profile);
+clock_profile clock_get_profile(void);
+
+#endif /* INC_CLOCK_H_ */
@@ -0,0 +1,38 @@
+/*
+ * color.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_COLOR_H_
+#define INC_COLOR_H_
+
+#include <stdint.h>
+
+/*
+ * HSV to RGB in integers only, for the RGB PWM channels of pwm.h. The hue
+ * circle has 256 steps per sextant (red, yellow, green, cyan, blue,
+ * magenta), so finding the sextant and the position in it is a shift and a
+ * mask instead of a division by 60 degrees. Saturation and value are
+ * 0..255. The result is in brightness levels 0..999, the scale of
+ * set_pwm_brightness() and pwm_stage(), which the gamma table then maps to
+ * duties: a conversion is a few multiplies and shifts, no division.
+ *
+ * This file and color.c use no HAL or kernel header and build on a host
+ * compiler.
+ */
+
+#define COLOR_HUE_SECTOR 256U
+#define COLOR_HUE_MAX    (6U * COLOR_HUE_SECTOR) // Hues are 0..COLOR_HUE_MAX - 1, red at 0
+#define COLOR_LEVEL_MAX  999U
+
+typedef struct
+{
+	uint16_t red;   // 0..COLOR_LEVEL_MAX
+	uint16_t green;
+	uint16_t blue;
+} color_rgb;
+
+color_rgb color_hsv(uint16_t hue, uint8_t saturation, uint8_t value);
+
+#endif /* INC_COLOR_H_ */
@@ -0,0 +1,70 @@
+/*
+ * console.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_CONSOLE_H_
+#define INC_CONSOLE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+
+// Policy applied when a write does not fit in the TX ring buffer
+#define CONSOLE_FULL_DROP      0 // Discard the bytes that do not fit
+#define CONSOLE_FULL_BLOCK     1 // Wait for the DMA to free space (task context only)
+#define CONSOLE_FULL_OVERWRITE 2 // Discard the oldest pending bytes to make room, never part of a frame
+
+// Binary frames (LOG records, telemetry) go through console_write_frame(),
+// which takes a frame whole or not at all under every policy. A decoder
+// then never sees a truncated frame.
+
+#ifndef CONSOLE_FULL_POLICY
+#define CONSOLE_FULL_POLICY CONSOLE_FULL_DROP
+#endif
+
+// How USART2 is driven. The shell RX path follows the same choice.
+#define CONSOLE_BACKEND_POLLING 0 // Original blocking __io_putchar path, shell RX on DMA
+#define CONSOLE_BACKEND_DMA     1 // Ring buffer drained by TX DMA, shell RX on circular DMA
+#define CONSOLE_BACKEND_FIFO    2 // Ring buffer drained by the TX FIFO threshold IRQ (uart_fifo.c)
+
+#ifndef CONSOLE_BACKEND
+#define CONSOLE_BACKEND CONSOLE_BACKEND_DMA
+#endif
+
+#ifndef CONSOLE_TX_BUFFER_SIZE
+#define CONSOLE_TX_BUFFER_SIZE 1024U // Must be a power of two
+#endif
+
+#ifndef CONSOLE_DMA_CHUNK_SIZE
+#define CONSOLE_DMA_CHUNK_SIZE 64U   // Largest single DMA transfer
+#endif
+
+#if (CONSOLE_TX_BUFFER_SIZE & (CONSOLE_TX_BUFFER_SIZE - 1U)) != 0U
+#error "CONSOLE_TX_BUFFER_SIZE must be a power of two"
+#endif
+
+typedef struct
+{
+	uint32_t write_calls;     // Number of _write() calls from task context
+	uint32_t bytes_written;   // Bytes accepted into the ring buffer
+	uint32_t bytes_dropped;   // Bytes lost to the full-buffer policy
+	uint32_t frames_dropped;  // Whole frames console_write_frame() refused
+	uint32_t blocked_last;    // CPU cycles the caller spent in the last _write()
+	uint32_t blocked_max;     // Worst case cycles spent in _write()
+	uint32_t blocked_total;   // Sum of cycles, divide by write_calls for the average
+} ConsoleProfiler;
+
+extern ConsoleProfiler ConsoleStats;
+
+void console_init(void);
+int console_write(const uint8_t *data, uint16_t len);
+int console_write_frame(const uint8_t *data, uint16_t len);
+uint16_t console_pending(void);
+uint16_t console_tx_pop(uint8_t *dst, uint16_t max, BaseType_t *pxHigherPriorityTaskWoken);
+
+#endif /* INC_CONSOLE_H_ */
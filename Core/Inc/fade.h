@@ -0,0 +1,92 @@
+/*
+ * fade.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_FADE_H_
+#define INC_FADE_H_
+
+#include <stdint.h>
+
+/*
+ * Brightness fades in fixed point. A fade goes from one level to another
+ * (0..FADE_LEVEL_MAX, the scale of set_pwm_brightness()) in a time given in
+ * ms and along an easing curve. fade_step() is told how much time has passed,
+ * so the fade takes the same time whatever the call rate. Starting a fade
+ * does the one division; a step is a multiply-add for the time, the curve
+ * (at most three multiplies, or a table lookup) and one multiply for the
+ * level, a few dozen cycles on the Cortex-M0+ single-cycle multiplier.
+ *
+ * Levels are perceptual. fade_gamma_duty() maps a level to a timer compare
+ * value through the gamma table generated by Tools/fade_tables.py (CIE
+ * lightness), interpolating between its 257 points, so equal level steps
+ * look like equal brightness steps on a timer period of up to 16 bits.
+ *
+ * This file and fade.c use no HAL or kernel header and build on a host
+ * compiler.
+ */
+
+#define FADE_LEVEL_MAX     999U // Same scale as set_pwm_brightness()
+#define FADE_GAMMA_POINTS  256U
+#define FADE_SINE_POINTS   64U
+#define FADE_ONE           (1UL << 24) // Fade position 1.0, Q24
+#define FADE_BREATH_POINTS 1024U
+#define FADE_BREATH_PERIOD 16000U // Timer period (ARR + 1) fade_breath[] is computed for
+
+typedef enum
+{
+	FADE_LINEAR = 0,
+	FADE_EASE_IN_OUT, // Smoothstep 3t^2 - 2t^3
+	FADE_SINE,        // (1 - cos(pi t)) / 2
+	FADE_CURVE_COUNT
+} fade_curve;
+
+typedef enum
+{
+	FADE_ONCE = 0,    // Stops at "to"
+	FADE_BOUNCE       // Back and forth between the levels, a breathing LED
+} fade_mode;
+
+typedef struct
+{
+	uint16_t from;
+	uint16_t to;
+	uint32_t position; // 0..FADE_ONE, Q24
+	uint32_t rate;     // Position per ms, Q24
+	uint16_t ms;       // Length of one leg
+	uint8_t curve;
+	uint8_t mode;
+	uint8_t done;
+} fade;
+
+extern const uint16_t fade_gamma[FADE_GAMMA_POINTS + 1U];
+extern const uint16_t fade_sine[FADE_SINE_POINTS + 1U];
+extern const uint16_t fade_breath[FADE_BREATH_POINTS]; // Compare values of one breath, off - full - off
+extern const char *const fade_curve_names[FADE_CURVE_COUNT];
+
+void fade_start(fade *f, uint16_t from, uint16_t to, uint16_t ms, fade_curve curve, fade_mode mode);
+uint16_t fade_step(fade *f, uint32_t elapsed_ms);
+
+// Timer compare value for a level on a period of "period" counts (at most
+// 65536): the level's perceived brightness as a duty. Inline, it runs for
+// every channel of a PWM update.
+static inline uint16_t fade_gamma_duty(uint16_t level, uint32_t period)
+{
+	// Full scale is CCR = ARR + 1, always on; the table would stop one count
+	// short. A 65536-count period cannot hold it and stays at 0xFFFF.
+	if(level >= FADE_LEVEL_MAX)
+	{
+		return (period > 0xFFFFU) ? 0xFFFFU : (uint16_t)period;
+	}
+
+	// 0..999 onto 256 intervals in 8.8 fixed point, 16794 / 256 = 65536 / 999
+	uint32_t pos = ((uint32_t)level * 16794U) >> 8;
+	uint32_t index = pos >> 8;
+	uint32_t frac = pos & 0xFFU;
+	uint32_t duty = fade_gamma[index] + ((((uint32_t)fade_gamma[index + 1U] - fade_gamma[index]) * frac) >> 8);
+
+	return (uint16_t)((duty * period) >> 16);
+}
+
+#endif /* INC_FADE_H_ */
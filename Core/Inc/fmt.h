@@ -0,0 +1,40 @@
+/*
+ * fmt.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_FMT_H_
+#define INC_FMT_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Small reentrant formatter. All state lives on the caller's stack, there is
+ * no heap and no newlib FILE, so it never reaches _sbrk() in sysmem.c.
+ *
+ * Conversions: %u %d %i %x %X %s %c %%, with '-' and '0' flags and a field
+ * width. The l, h and z length modifiers are accepted and ignored because
+ * those arguments are 32 bits wide on the Cortex-M0+. 64-bit conversions
+ * (ll, j) are not supported: the argument is skipped and the conversion is
+ * printed verbatim, e.g. "%llu".
+ */
+
+// 1 = fmt.c provides printf, vprintf, puts, putchar, snprintf and vsnprintf,
+// so newlib's vfprintf is not linked and configUSE_NEWLIB_REENTRANT is 0
+#ifndef FMT_REPLACE_PRINTF
+#define FMT_REPLACE_PRINTF 0
+#endif
+
+#ifndef FMT_CHUNK_SIZE
+#define FMT_CHUNK_SIZE 32U // Stack buffer handed to the console in one _write()
+#endif
+
+int fmt_vprintf(const char *format, va_list ap);
+int fmt_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+int fmt_vsnprintf(char *buf, size_t size, const char *format, va_list ap);
+int fmt_snprintf(char *buf, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#endif /* INC_FMT_H_ */
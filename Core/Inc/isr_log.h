@@ -0,0 +1,92 @@
+/*
+ * isr_log.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_ISR_LOG_H_
+#define INC_ISR_LOG_H_
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "log.h"
+#include "timestamp.h"
+
+/*
+ * Lock-free log channel for interrupt handlers. Every channel is a
+ * single-producer/single-consumer ring: one ISR writes the head, the drain
+ * task writes the tail, so no critical section is needed on either side.
+ * ISR_LOG() costs a timestamp read, four stores into the record, a barrier
+ * and the head store, with no kernel call. Give every interrupt handler its own channel.
+ */
+
+#ifndef ISR_LOG_DEPTH
+#define ISR_LOG_DEPTH 16U // Records per channel, must be a power of two
+#endif
+
+#ifndef ISR_LOG_DRAIN_PERIOD_MS
+#define ISR_LOG_DRAIN_PERIOD_MS 10U
+#endif
+
+#if (ISR_LOG_DEPTH & (ISR_LOG_DEPTH - 1U)) != 0U
+#error "ISR_LOG_DEPTH must be a power of two"
+#endif
+
+typedef enum
+{
+	ISR_LOG_CH_BUTTON = 0, // EXTI4_15_IRQHandler, TIM16_IRQHandler
+	ISR_LOG_CH_COUNT
+} isr_log_channel_id;
+
+typedef struct
+{
+	uint32_t timestamp; // timestamp_now() when the event was recorded
+	uint32_t arg;
+	uint16_t id;        // Offset of the format string in .log_fmt
+	uint8_t nargs;
+} isr_log_record;
+
+typedef struct
+{
+	volatile uint8_t head; // Written by the producing ISR only
+	volatile uint8_t tail; // Written by the drain task only
+	volatile uint32_t dropped;
+	isr_log_record records[ISR_LOG_DEPTH];
+} isr_log_channel;
+
+extern isr_log_channel isr_log_channels[ISR_LOG_CH_COUNT];
+
+void vLogDrainTask(void *pvParameters);
+
+static inline void isr_log_put(isr_log_channel *ch, const char *fmt, uint8_t nargs, uint32_t arg)
+{
+	uint8_t head = ch->head;
+	uint8_t next = (uint8_t)((head + 1U) & (ISR_LOG_DEPTH - 1U));
+
+	if(next == ch->tail)
+	{
+		ch->dropped++;
+		return;
+	}
+
+	isr_log_record *rec = &ch->records[head];
+	rec->timestamp = timestamp_now();
+	rec->arg = arg;
+	rec->id = (uint16_t)(uintptr_t)fmt;
+	rec->nargs = nargs;
+
+	__DMB(); // Record must be visible before the new head
+	ch->head = next;
+}
+
+// ISR_LOG(ISR_LOG_CH_BUTTON, "fmt") or ISR_LOG(ISR_LOG_CH_BUTTON, "fmt %u", value)
+#define ISR_LOG(channel, fmt, ...) \
+	do \
+	{ \
+		static const char log_fmt_[] __attribute__((section(".log_fmt"), used)) = fmt; \
+		const uint32_t log_args_[] = { 0U LOG_CAT(LOG_ARGS_, LOG_NARGS(__VA_ARGS__))(__VA_ARGS__), 0U }; \
+		_Static_assert(LOG_NARGS(__VA_ARGS__) <= 1, "ISR_LOG takes at most one argument"); \
+		isr_log_put(&isr_log_channels[channel], log_fmt_, LOG_NARGS(__VA_ARGS__), log_args_[1]); \
+	} while(0)
+
+#endif /* INC_ISR_LOG_H_ */
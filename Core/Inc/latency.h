@@ -0,0 +1,154 @@
+/*
+ * latency.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_LATENCY_H_
+#define INC_LATENCY_H_
+
+#include <stdint.h>
+
+#include "timestamp.h"
+
+/*
+ * Latency histograms of the button-to-LED path, stamped with the TIM2
+ * microsecond counter (timestamp_now()):
+ *
+ *   debounce    EXTI4_15 first edge -> TIM16 samples the settled pin
+ *   receive     gesture event queued in TIM16 -> the button task has it
+ *               out of the queue (the task wake)
+ *   first-edge  origin_us of a pattern request (the event time for a
+ *               button) -> first LED edge of the pattern
+ *   pattern     TIM7 ends a pattern -> the Pattern Generator task wakes
+ *
+ * latency_add() only stores the raw delta into a small ring per stage,
+ * about 13 cycles counted from the instructions, no compare and no lock:
+ * each stage is written from one context only (one ISR, one task, or tasks
+ * with the scheduler suspended), so the producer owns the head. A producer more than LATENCY_RING_SIZE
+ * samples ahead overwrites the oldest ones, which are then counted in
+ * "dropped". latency_drain() takes the samples out in task context, in a
+ * short critical section each, and bins them: fixed log2 bins, no heap,
+ * bin 0 counts 0 us, bin b counts 2^(b-1) .. 2^b - 1 us, found with three
+ * compares and a 16-byte table instead of a count-leading-zeros the
+ * Cortex-M0+ does not have. The button task drains after every event,
+ * latency_summarize() before it reads.
+ *
+ * latency_summarize() gives the count, min, max and p50/p99. A percentile
+ * is interpolated inside its bin, so it is within a factor of two at worst,
+ * and clamped to the min and max seen.
+ */
+
+#define LATENCY_BINS 33U // 0 us, then one per bit of a 32-bit delta
+
+#ifndef LATENCY_RING_SIZE
+#define LATENCY_RING_SIZE 16U // Samples per stage between drains, must be a power of two
+#endif
+
+#if (LATENCY_RING_SIZE & (LATENCY_RING_SIZE - 1U)) != 0U
+#error "LATENCY_RING_SIZE must be a power of two"
+#endif
+
+typedef enum
+{
+	LATENCY_DEBOUNCE = 0,
+	LATENCY_RECEIVE,
+	LATENCY_FIRST_EDGE,
+	LATENCY_PATTERN_WAKE,
+	LATENCY_STAGE_COUNT
+} latency_stage;
+
+typedef struct
+{
+	uint32_t bins[LATENCY_BINS];
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t last_us;
+	uint32_t dropped; // Overwritten in the ring before a drain
+} latency_hist;
+
+typedef struct
+{
+	volatile uint32_t samples[LATENCY_RING_SIZE];
+	volatile uint32_t head; // Free running, written by the producer only
+	uint32_t tail;          // Free running, written in latency_drain() only
+} latency_ring;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t p50_us;
+	uint32_t p99_us;
+	uint32_t dropped;
+} latency_summary;
+
+extern latency_hist latency_hists[LATENCY_STAGE_COUNT];
+extern latency_ring latency_rings[LATENCY_STAGE_COUNT];
+extern const uint8_t latency_log2[16];
+extern const char *const latency_stage_names[LATENCY_STAGE_COUNT];
+
+void latency_reset(void);
+void latency_drain(void);
+uint32_t latency_summarize(const latency_hist *h, latency_summary *summary);
+
+// Bin of a delta, floor(log2(us)) + 1, 0 for 0
+static inline uint32_t latency_bin(uint32_t us)
+{
+	uint32_t bin = 0;
+
+	if(us >= 0x10000U)
+	{
+		us >>= 16;
+		bin = 16;
+	}
+	if(us >= 0x100U)
+	{
+		us >>= 8;
+		bin += 8;
+	}
+	if(us >= 0x10U)
+	{
+		us >>= 4;
+		bin += 4;
+	}
+	return bin + latency_log2[us];
+}
+
+static inline void latency_record(latency_hist *h, uint32_t us)
+{
+	h->bins[latency_bin(us)]++;
+	h->last_us = us;
+	if(us < h->min_us)
+	{
+		h->min_us = us;
+	}
+	if(us > h->max_us)
+	{
+		h->max_us = us;
+	}
+}
+
+// The raw delta for the next latency_drain(). The volatile stores keep the
+// sample ahead of the head, which is all a single-core M0+ needs.
+static inline void latency_push(latency_ring *r, uint32_t us)
+{
+	uint32_t head = r->head;
+
+	r->samples[head & (LATENCY_RING_SIZE - 1U)] = us;
+	r->head = head + 1U;
+}
+
+static inline void latency_add(latency_stage stage, uint32_t us)
+{
+	latency_push(&latency_rings[stage], us);
+}
+
+// Delta from a timestamp_now() value to now
+static inline void latency_since(latency_stage stage, uint32_t start_us)
+{
+	latency_push(&latency_rings[stage], timestamp_now() - start_us);
+}
+
+#endif /* INC_LATENCY_H_ */
@@ -15,9 +15,35 @@
 #include "cmsis_os.h"
 #include "stm32g071xx.h"
 
+// GPIOC pin numbers and masks of the on-board LEDs
+#define LED_GREEN_PIN  10U
+#define LED_BLUE_PIN   11U // TIM1_CH4 alternate function, driven by pwm.c
+#define LED_RED_PIN    12U
+
+#define LED_MASK_GREEN (1U << LED_GREEN_PIN)
+#define LED_MASK_BLUE  (1U << LED_BLUE_PIN)
+#define LED_MASK_RED   (1U << LED_RED_PIN)
+#define LED_MASK_ALL   (LED_MASK_GREEN | LED_MASK_BLUE | LED_MASK_RED)
+
+typedef enum
+{
+	LED_GREEN,
+	LED_BLUE,
+	LED_RED,
+	LED_COUNT
+} led_id;
+
+extern const uint16_t led_masks[LED_COUNT];
+extern const char *const led_names[LED_COUNT];
+
 void led_gpio_init(void);
-void led_on(uint16_t led_pin);
-void led_off(uint16_t led_pin);
+
+// Sets and clears any mix of GPIOC pins in one BSRR write, no read-modify-write
+// so it needs no critical section. A pin in both masks ends up set.
+static inline void led_frame(uint16_t set_mask, uint16_t clear_mask)
+{
+	GPIOC->BSRR = ((uint32_t)clear_mask << 16) | set_mask;
+}
 
 
 
@@ -0,0 +1,64 @@
+/*
+ * led_arb.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_LED_ARB_H_
+#define INC_LED_ARB_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+#include "led.h"
+
+/*
+ * LED ownership by priority layer. Every layer keeps its own copy of the pin
+ * states and the blue PWM level; a write goes to the hardware only for the
+ * LEDs whose highest claimed layer is the writer, the rest is just stored.
+ * The background layer (LED scheduler, blue fade) owns every LED and never
+ * stops running. A pattern claims the LEDs, which then show its state, and
+ * on release they show the background state of that moment.
+ *
+ * LEDs are named by their GPIOC masks, LED_MASK_BLUE stands for the TIM1
+ * PWM channel. Writes cost the same whatever the number of LEDs: a few mask
+ * operations and one BSRR or CCR4 store in a short critical section, safe
+ * from tasks and from interrupts.
+ *
+ * led_arb_brightness() dims an LED of a layer, 0..999 as for
+ * set_pwm_brightness(): blue through its PWM level, the GPIO LEDs through
+ * the bit-angle modulation engine (bam.h). A dimmed LED shows its level
+ * instead of its pin state until the layer sets it back to
+ * LED_ARB_SWITCHED. BAM drives a pin only while the layer on top of it has
+ * it dimmed, so a pattern claiming the LED gets plain on/off again.
+ */
+
+#define LED_ARB_SWITCHED 0xFFFFU // led_arb_brightness(): back to on/off
+
+typedef enum
+{
+	LED_LAYER_BACKGROUND = 0, // Owns every LED, cannot be released
+	LED_LAYER_PATTERN,
+	LED_LAYER_COUNT
+} led_layer;
+
+typedef struct
+{
+	uint32_t writes;   // led_arb_frame() and led_arb_pwm() calls
+	uint32_t shadowed; // Writes fully hidden by a higher layer
+	uint32_t claims;
+} LedArbProfiler;
+
+extern LedArbProfiler LedArbStats;
+
+void led_arb_claim(led_layer layer, uint16_t mask);
+void led_arb_release(led_layer layer, uint16_t mask);
+void led_arb_refresh(uint16_t mask);
+void led_arb_frame(led_layer layer, uint16_t set_mask, uint16_t clear_mask);
+void led_arb_pwm(led_layer layer, uint16_t level);
+void led_arb_brightness(led_layer layer, led_id led, uint16_t level);
+led_layer led_arb_owner(led_id led);
+
+#endif /* INC_LED_ARB_H_ */
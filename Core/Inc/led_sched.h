@@ -0,0 +1,63 @@
+/*
+ * led_sched.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_LED_SCHED_H_
+#define INC_LED_SCHED_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+
+/*
+ * Periodic LED channels run from one FreeRTOS software timer. Each channel
+ * has a period, a duty (percent of the period the pins are on) and a phase
+ * (offset of the first period start). The channels are kept in a table
+ * sorted by their next deadline; the timer callback handles every channel
+ * that is due, writes all pin changes of that instant with one write on the
+ * background layer of led_arb and re-arms the one-shot timer for the new
+ * head of the table. While a pattern owns the LEDs the channels keep running
+ * and only their stored state changes.
+ *
+ * A channel with a zero mask only calls its callback at every period start,
+ * which is how the blue PWM fade runs. Callbacks run in the timer service
+ * task after the pins have been written and must not block.
+ *
+ * Deadlines stay on the grid set by the phase: a channel whose deadline is
+ * a period or more late (the timer task was held off) jumps to the current
+ * period of that grid and takes its pin state from the point reached in it.
+ * The missed periods are skipped, not replayed as a burst, and counted per
+ * channel (led_sched_overruns()).
+ *
+ * The table costs 32 bytes of RAM per channel and no task, so raising
+ * LED_SCHED_MAX_CHANNELS (at most 32) only grows the table.
+ */
+
+#ifndef LED_SCHED_MAX_CHANNELS
+#define LED_SCHED_MAX_CHANNELS 8U
+#endif
+
+#define LED_SCHED_MAX_PERIOD_MS 60000U
+
+typedef struct
+{
+	const char *name;
+	uint16_t mask;          // GPIOC pins switched by the channel, 0 = callback only
+	void (*callback)(void); // Called at every period start, may be NULL
+	uint16_t period_ms;     // 1..LED_SCHED_MAX_PERIOD_MS
+	uint8_t duty;           // 0..100 % of the period the pins are on
+	uint16_t phase_ms;      // First period starts this long after led_sched_add()
+} led_sched_config; // Referenced, not copied: keep it in static storage
+
+void led_sched_init(void);
+int led_sched_add(const led_sched_config *config);
+int led_sched_find(const char *name);
+int led_sched_set_timing(uint8_t channel, uint32_t period_ms, uint8_t duty);
+const led_sched_config *led_sched_get(uint8_t channel, uint32_t *period_ms, uint8_t *duty, uint32_t *runs);
+int led_sched_overruns(uint8_t channel, uint32_t *overruns, uint32_t *skipped);
+
+#endif /* INC_LED_SCHED_H_ */
@@ -0,0 +1,160 @@
+/*
+ * log.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_LOG_H_
+#define INC_LOG_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "console.h"
+
+/*
+ * Tokenized logging. The format string is placed in the non-loaded .log_fmt
+ * section (see STM32G071R8TX_FLASH.ld), so it costs no flash. Only its offset
+ * in that section (the string ID) and the raw arguments go over USART2:
+ *
+ *   LOG_SYNC    | id[7:0] | id[15:8] | arg0 varint | arg1 varint | ...
+ *   LOG_SYNC_TS | timestamp[31:0] LE | id[7:0] | id[15:8] | args ...
+ *
+ * The timestamp is the TIM2 microsecond counter (timestamp.h), which lines
+ * task frames up with ISR_LOG() records flushed later by the drain task.
+ *
+ * Tools/log_decode.py rebuilds the text from the ELF file. Arguments are
+ * passed as 32-bit values, %s arguments must point to strings in flash.
+ * Supported conversions: %u %d %i %x %X %c %s %p.
+ */
+
+#define LOG_SYNC      0xA5U // Never appears in the 7-bit ASCII text of the shell
+#define LOG_SYNC_TS   0xA6U
+#define LOG_MAX_ARGS  8U
+
+// 1 = LOG() frames carry a timestamp too (+4 bytes each), 0 = only ISR_LOG()
+// records do, which keeps task frames at 3-4 bytes
+#ifndef LOG_TIMESTAMPS
+#define LOG_TIMESTAMPS 0
+#endif
+
+void log_write(const char *fmt, const uint32_t *args, uint32_t nargs);
+void log_write_at(uint32_t timestamp, const char *fmt, const uint32_t *args, uint32_t nargs);
+
+#define LOG_CAT_(a, b) a##b
+#define LOG_CAT(a, b)  LOG_CAT_(a, b)
+
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+#define LOG_NARGS(...) LOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define LOG_ARG(a) , (uint32_t)(uintptr_t)(a)
+#define LOG_ARGS_0()
+#define LOG_ARGS_1(a)      LOG_ARG(a)
+#define LOG_ARGS_2(a, ...) LOG_ARG(a) LOG_ARGS_1(__VA_ARGS__)
+#define LOG_ARGS_3(a, ...) LOG_ARG(a) LOG_ARGS_2(__VA_ARGS__)
+#define LOG_ARGS_4(a, ...) LOG_ARG(a) LOG_ARGS_3(__VA_ARGS__)
+#define LOG_ARGS_5(a, ...) LOG_ARG(a) LOG_ARGS_4(__VA_ARGS__)
+#define LOG_ARGS_6(a, ...) LOG_ARG(a) LOG_ARGS_5(__VA_ARGS__)
+#define LOG_ARGS_7(a, ...) LOG_ARG(a) LOG_ARGS_6(__VA_ARGS__)
+#define LOG_ARGS_8(a, ...) LOG_ARG(a) LOG_ARGS_7(__VA_ARGS__)
+
+#define LOG(fmt, ...) \
+	do \
+	{ \
+		static const char log_fmt_[] __attribute__((section(".log_fmt"), used)) = fmt; \
+		const uint32_t log_args_[] = { 0U LOG_CAT(LOG_ARGS_, LOG_NARGS(__VA_ARGS__))(__VA_ARGS__) }; \
+		log_write(log_fmt_, &log_args_[1], LOG_NARGS(__VA_ARGS__)); \
+	} while(0)
+
+/*
+ * Severity levels and per-module filtering. Each module's compile-time level
+ * decides which messages exist at all: a disabled LOG_DEBUG(PWM, ...) expands
+ * to an empty statement, so neither code nor format string is emitted and the
+ * arguments are not evaluated. Enabled messages are filtered again at run time
+ * by log_threshold[], which the shell "log" command changes.
+ *
+ *   -DLOG_LEVEL_DEFAULT=LOG_LEVEL_ERROR             production build
+ *   -DLOG_MODULE_BUTTON=LOG_LEVEL_DEBUG             one module more verbose
+ */
+#define LOG_LEVEL_OFF   0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_COUNT 5
+
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_DEBUG
+#endif
+
+#ifndef LOG_MODULE_BUTTON
+#define LOG_MODULE_BUTTON  LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_MODULE_PATTERN
+#define LOG_MODULE_PATTERN LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_MODULE_LED
+#define LOG_MODULE_LED     LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_MODULE_PWM
+#define LOG_MODULE_PWM     LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_MODULE_KERNEL
+#define LOG_MODULE_KERNEL  LOG_LEVEL_DEFAULT
+#endif
+
+typedef enum
+{
+	LOG_MOD_BUTTON,
+	LOG_MOD_PATTERN,
+	LOG_MOD_LED,
+	LOG_MOD_PWM,
+	LOG_MOD_KERNEL,
+	LOG_MOD_COUNT
+} log_module_id;
+
+extern volatile uint8_t log_threshold[LOG_MOD_COUNT];
+extern const char *const log_module_names[LOG_MOD_COUNT];
+
+// LOG_ON_<severity>_<module level> is 1 when the message is compiled in
+#define LOG_ON_1_0 0
+#define LOG_ON_1_1 1
+#define LOG_ON_1_2 1
+#define LOG_ON_1_3 1
+#define LOG_ON_1_4 1
+#define LOG_ON_2_0 0
+#define LOG_ON_2_1 0
+#define LOG_ON_2_2 1
+#define LOG_ON_2_3 1
+#define LOG_ON_2_4 1
+#define LOG_ON_3_0 0
+#define LOG_ON_3_1 0
+#define LOG_ON_3_2 0
+#define LOG_ON_3_3 1
+#define LOG_ON_3_4 1
+#define LOG_ON_4_0 0
+#define LOG_ON_4_1 0
+#define LOG_ON_4_2 0
+#define LOG_ON_4_3 0
+#define LOG_ON_4_4 1
+
+#define LOG_GATE_0(module, level, ...) do { } while(0)
+#define LOG_GATE_1(module, level, ...) \
+	do \
+	{ \
+		if((level) <= log_threshold[LOG_MOD_##module]) \
+		{ \
+			__VA_ARGS__; \
+		} \
+	} while(0)
+
+// Runs statement only if module logs at level, e.g. LOG_IF(BUTTON, LOG_LEVEL_ERROR, ISR_LOG(...))
+#define LOG_IF(module, level, ...) \
+	LOG_CAT(LOG_GATE_, LOG_CAT(LOG_CAT(LOG_ON_, level), LOG_CAT(_, LOG_MODULE_##module)))(module, level, __VA_ARGS__)
+
+#define LOG_ERROR(module, ...) LOG_IF(module, LOG_LEVEL_ERROR, LOG(__VA_ARGS__))
+#define LOG_WARN(module, ...)  LOG_IF(module, LOG_LEVEL_WARN, LOG(__VA_ARGS__))
+#define LOG_INFO(module, ...)  LOG_IF(module, LOG_LEVEL_INFO, LOG(__VA_ARGS__))
+#define LOG_DEBUG(module, ...) LOG_IF(module, LOG_LEVEL_DEBUG, LOG(__VA_ARGS__))
+
+#endif /* INC_LOG_H_ */
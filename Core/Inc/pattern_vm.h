@@ -0,0 +1,105 @@
+/*
+ * pattern_vm.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_PATTERN_VM_H_
+#define INC_PATTERN_VM_H_
+
+#include <stdint.h>
+
+/*
+ * Bytecode interpreter for LED patterns. A pattern is a byte array, usually
+ * const in flash; operands are little-endian:
+ *
+ *   SET   mask16             pins on   (GPIOC mask)
+ *   CLEAR mask16             pins off
+ *   PWM   level16            blue PWM level, 0..PATTERN_VM_PWM_MAX
+ *   WAIT  ms16               hold the outputs
+ *   LOOP  count8 ... NEXT    run the block count (1..255) times, nestable
+ *   RAMP  from16 to16 ms16   PWM level from -> to in PATTERN_VM_RAMP_STEP_MS steps
+ *   PWMD  delta8             PWM level += signed delta, needs a PWM or RAMP before it
+ *   WAITB ms8                WAIT in one byte for holds below 256 ms
+ *   END
+ *
+ * pattern_vm_run() executes instructions until the outputs must be held and
+ * returns how long, in ms. The caller sleeps (or loads a timer) and calls it
+ * again. All state is in the fixed-size pattern_vm context, and a pattern
+ * that passes pattern_vm_check() always ends, after exactly the duration the
+ * check reports, so playback is deterministic.
+ *
+ * This file and pattern_vm.c use no HAL or kernel header and build on a host
+ * compiler; outputs go through the pattern_vm_io callbacks.
+ */
+
+#define PATTERN_VM_OP_END   0x00U
+#define PATTERN_VM_OP_SET   0x01U
+#define PATTERN_VM_OP_CLEAR 0x02U
+#define PATTERN_VM_OP_PWM   0x03U
+#define PATTERN_VM_OP_WAIT  0x04U
+#define PATTERN_VM_OP_LOOP  0x05U
+#define PATTERN_VM_OP_NEXT  0x06U
+#define PATTERN_VM_OP_RAMP  0x07U
+#define PATTERN_VM_OP_PWMD  0x08U
+#define PATTERN_VM_OP_WAITB 0x09U
+
+#define PATTERN_VM_VERSION  2U // Bumped when the instruction set changes
+
+#ifndef PATTERN_VM_MAX_DEPTH
+#define PATTERN_VM_MAX_DEPTH   4U  // Nested LOOP levels
+#endif
+
+#ifndef PATTERN_VM_RAMP_STEP_MS
+#define PATTERN_VM_RAMP_STEP_MS 10U
+#endif
+
+#define PATTERN_VM_PWM_MAX     999U // Same scale as set_pwm_brightness()
+
+#define PATTERN_VM_ERROR (-1)
+
+// Initialisers for pattern byte arrays
+#define PATTERN_VM_U16(v)          (uint8_t)((v) & 0xFFU), (uint8_t)(((v) >> 8) & 0xFFU)
+#define PATTERN_SET(mask)          PATTERN_VM_OP_SET, PATTERN_VM_U16(mask)
+#define PATTERN_CLEAR(mask)        PATTERN_VM_OP_CLEAR, PATTERN_VM_U16(mask)
+#define PATTERN_PWM(level)         PATTERN_VM_OP_PWM, PATTERN_VM_U16(level)
+#define PATTERN_WAIT(ms)           PATTERN_VM_OP_WAIT, PATTERN_VM_U16(ms)
+#define PATTERN_LOOP(count)        PATTERN_VM_OP_LOOP, (uint8_t)(count)
+#define PATTERN_NEXT()             PATTERN_VM_OP_NEXT
+#define PATTERN_RAMP(from, to, ms) PATTERN_VM_OP_RAMP, PATTERN_VM_U16(from), PATTERN_VM_U16(to), PATTERN_VM_U16(ms)
+#define PATTERN_PWMD(delta)        PATTERN_VM_OP_PWMD, (uint8_t)(int8_t)(delta)
+#define PATTERN_WAITB(ms)          PATTERN_VM_OP_WAITB, (uint8_t)(ms)
+#define PATTERN_END()              PATTERN_VM_OP_END
+
+typedef struct
+{
+	void (*frame)(uint16_t set_mask, uint16_t clear_mask);
+	void (*pwm)(uint16_t level);
+} pattern_vm_io;
+
+typedef struct
+{
+	const uint8_t *code;
+	const pattern_vm_io *io;
+	uint16_t length;
+	uint16_t pc;
+	uint8_t depth;
+	uint8_t ramping;
+	uint16_t level;        // Last PWM level written, base of PWMD
+	uint16_t ramp_steps;   // Steps left in the running RAMP
+	uint16_t ramp_last_ms; // Length of the final, possibly shorter, step
+	uint16_t ramp_to;
+	int32_t ramp_level;    // 16.16 fixed point
+	int32_t ramp_delta;    // Per step, 16.16 fixed point
+	struct
+	{
+		uint16_t start;    // pc of the first instruction in the block
+		uint8_t remaining; // Passes left after the current one
+	} loop[PATTERN_VM_MAX_DEPTH];
+} pattern_vm;
+
+int32_t pattern_vm_check(const uint8_t *code, uint16_t length);
+void pattern_vm_init(pattern_vm *vm, const uint8_t *code, uint16_t length, const pattern_vm_io *io);
+int32_t pattern_vm_run(pattern_vm *vm);
+
+#endif /* INC_PATTERN_VM_H_ */
@@ -0,0 +1,38 @@
+/*
+ * patterns.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_PATTERNS_H_
+#define INC_PATTERNS_H_
+
+#include <stdint.h>
+
+#include "pattern_vm.h"
+
+/*
+ * LED patterns as pattern_vm bytecode in the PATTERNS flash region
+ * (STM32G071R8TX_FLASH.ld). Tools/pattern_compile.py builds the blob from
+ * Patterns/default.pat into Core/Src/pattern_blob.c; it can also be
+ * programmed at that address on its own. The index gives the code of an ID
+ * in O(1), an ID with no code is unused.
+ */
+
+#define PATTERN_BLOB_MAGIC   0x42544150UL // "PATB"
+#define PATTERN_BLOB_VERSION 1U
+
+typedef struct
+{
+	uint32_t magic;
+	uint8_t version;      // PATTERN_BLOB_VERSION
+	uint8_t vm_version;   // PATTERN_VM_VERSION the code was compiled for
+	uint16_t count;       // IDs 0..count-1
+	uint32_t size;        // Whole blob, bytes
+	uint16_t offset[];    // count + 1 entries, ID i is offset[i]..offset[i+1] from the blob start
+} pattern_blob_header;
+
+uint8_t pattern_count(void);
+const uint8_t *pattern_get(uint8_t id, uint16_t *length);
+
+#endif /* INC_PATTERNS_H_ */
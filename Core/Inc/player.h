@@ -0,0 +1,74 @@
+/*
+ * player.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_PLAYER_H_
+#define INC_PLAYER_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+
+/*
+ * Pattern player. player_request() never blocks: it decides against the
+ * pattern that is playing right away and, when the new one is to run, stops
+ * TIM7, claims the LEDs on the pattern layer of led_arb and writes the first
+ * outputs of the new pattern before it returns. The pattern task only
+ * handles the end of a pattern (next queued one, or release of the LEDs,
+ * which then show the LED scheduler again).
+ *
+ *   PLAYER_LATEST    a new request cancels the running pattern
+ *   PLAYER_QUEUE     requests wait in FIFO order behind the running pattern
+ *   PLAYER_PRIORITY  a higher priority cancels, others wait highest first
+ *
+ * A request that cannot be queued is dropped and player_request() returns -1.
+ * origin_us (a timestamp_now() value, e.g. taken in the button interrupt) is
+ * the start of the latency measured to the first edge of the pattern, kept
+ * in the LATENCY_FIRST_EDGE histogram (latency.h).
+ */
+
+#ifndef PLAYER_QUEUE_LEN
+#define PLAYER_QUEUE_LEN 4U
+#endif
+
+#ifndef PLAYER_DEFAULT_POLICY
+#define PLAYER_DEFAULT_POLICY PLAYER_LATEST
+#endif
+
+#define PLAYER_GRACE_MS 100U // Past its length a pattern is stopped by the task
+
+typedef enum
+{
+	PLAYER_LATEST = 0,
+	PLAYER_QUEUE,
+	PLAYER_PRIORITY,
+	PLAYER_POLICY_COUNT
+} player_policy;
+
+typedef struct
+{
+	uint32_t requests;
+	uint32_t started;
+	uint32_t preempted;      // Running patterns cancelled by a request
+	uint32_t queued;
+	uint32_t dropped;        // Queue full or invalid pattern
+	uint32_t completed;
+	uint32_t overruns;       // Stopped by the task PLAYER_GRACE_MS past their length
+} PlayerProfiler;
+
+extern PlayerProfiler PlayerStats;
+extern TaskHandle_t xPatternTaskHandle;
+extern const char *const player_policy_names[PLAYER_POLICY_COUNT];
+
+int player_request(uint8_t id, uint8_t priority, uint32_t origin_us);
+void player_set_policy(player_policy policy);
+player_policy player_get_policy(void);
+uint8_t player_queue_fill(void);
+uint32_t player_read_queue_fill(const void *arg);
+void vPatternGeneratorTask(void *pvParameters);
+
+#endif /* INC_PLAYER_H_ */
@@ -4,11 +4,67 @@
 #include "main.h"
 #include "cmsis_os.h"
 #include "stm32g071xx.h"
+#include "log.h"
+#include "color.h"
+
+// The PWM timers run at the frequency asked for with the longest period that
+// fits, computed from their live clock (timer_alloc.h). pwm_set_frequency()
+// changes it at run time without a glitch, levels 0..999 keep their
+// brightness at any resolution through the gamma table.
+#ifndef PWM_FREQ_HZ
+#define PWM_FREQ_HZ 1000U // Frequency at start, pwm_set_frequency() changes it
+#endif
+
+#define PWM_FREQ_MAX_HZ 64000U // Flicker-free for cameras; 250 counts (7.97 bits) at 16 MHz
+
+// PWM channels on the LED pins, up to four per timer. pwm_init() enables
+// blue; red and green stay GPIO outputs of the LED scheduler until
+// pwm_channel_enable() hands their pins to the timer. pwm_stage() stores a
+// level and pwm_commit() writes every staged channel at once, so an RGB
+// change appears in one PWM frame. set_pwm_duty_cycle() and
+// set_pwm_brightness() write the blue channel directly, as before.
+typedef enum
+{
+	PWM_RED = 0,   // PC12, TIM14_CH1
+	PWM_GREEN,     // PC10, TIM1_CH3
+	PWM_BLUE,      // PC11, TIM1_CH4
+	PWM_CHANNEL_COUNT
+} pwm_channel;
+
+extern const char *const pwm_channel_names[PWM_CHANNEL_COUNT];
+
+// Blue LED breathing without CPU: every TIM1 update event (every
+// repetition-counter + 1 PWM periods) requests DMA1 channel 3, which copies
+// the next value of fade_breath[] (flash, circular; a scaled RAM copy when
+// the period is not FADE_BREATH_PERIOD) into the CCR4 preload.
+// set_pwm_brightness() and set_pwm_duty_cycle() stop the requests and take
+// CCR4 over; set_pwm_brightness(PWM_BRIGHTNESS_BREATH) hands it back and the
+// breath goes on from where it stopped.
+#ifndef PWM_BREATH_DMA
+#define PWM_BREATH_DMA 1 // 0: the LED scheduler steps the blue fade in software
+#endif
+
+#ifndef PWM_BREATH_MS
+#define PWM_BREATH_MS 4096U // One breath, rounded to a multiple of FADE_BREATH_POINTS PWM periods
+#endif
+
+#define PWM_BREATH_MAX_MS      60000U // Keeps the repetition count in 16 bits up to 64 kHz PWM
+#define PWM_BREATH_DMA_CHANNEL DMA1_Channel3
+#define PWM_BREATH_DMAMUX      DMAMUX1_Channel2 // DMAMUX channel n - 1 serves DMA channel n
+#define PWM_BRIGHTNESS_BREATH  0xFFFFU          // set_pwm_brightness(): CCR4 back to the breath DMA
 
 void pwm_init(void);
+int pwm_channel_enable(pwm_channel ch);
+void pwm_channel_disable(pwm_channel ch);
+void pwm_stage(pwm_channel ch, uint16_t level);
+void pwm_commit(void);
+void pwm_set_rgb(color_rgb color);
 void set_pwm_duty_cycle(uint8_t duty_percent);
 void set_pwm_brightness(uint16_t brightness);
-void pwm_fade(void);
+int pwm_set_frequency(uint32_t freq_hz, uint8_t min_bits);
+uint32_t pwm_get_frequency(uint32_t *freq_mhz, uint32_t *counts, uint8_t *bits);
+int pwm_breath_start(uint32_t breath_ms);
+int pwm_breath_get(uint32_t *breath_ms, uint32_t *position, uint8_t *streaming);
 
 
 #endif /* INC_PWM_H_ */
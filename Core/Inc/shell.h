@@ -0,0 +1,49 @@
+/*
+ * shell.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_SHELL_H_
+#define INC_SHELL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+
+#ifndef SHELL_RX_DMA_SIZE
+#define SHELL_RX_DMA_SIZE     128U // Circular DMA buffer, ~11 ms of data at 115200 baud
+#endif
+
+#ifndef SHELL_RX_STREAM_SIZE
+#define SHELL_RX_STREAM_SIZE  256U // Bytes buffered between the UART IRQ and the shell task
+#endif
+
+#ifndef SHELL_LINE_SIZE
+#define SHELL_LINE_SIZE       64U
+#endif
+
+#ifndef SHELL_ECHO
+#define SHELL_ECHO            1
+#endif
+
+typedef struct
+{
+	uint32_t rx_events;   // Idle-line, half and full transfer events
+	uint32_t rx_bytes;
+	uint32_t rx_dropped;  // Bytes the shell task did not pick up in time
+	uint32_t rx_errors;   // UART errors, reception is restarted after each one
+	uint32_t lines;
+	uint32_t overlong;    // Lines longer than SHELL_LINE_SIZE
+} ShellProfiler;
+
+extern ShellProfiler ShellStats;
+
+void shell_init(void);
+void shell_rx_from_isr(const uint8_t *data, uint16_t len, BaseType_t *pxHigherPriorityTaskWoken);
+void vShellTask(void *pvParameters);
+
+#endif /* INC_SHELL_H_ */
@@ -0,0 +1,77 @@
+/*
+ * telemetry.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_TELEMETRY_H_
+#define INC_TELEMETRY_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+
+/*
+ * Binary telemetry over USART2. The Telemetry task samples every registered
+ * variable at telemetry_set_rate() Hz and sends one frame per sample:
+ *
+ *   TELEMETRY_SYNC | COBS(record) | 0x00
+ *
+ *   record = type | seq (16-bit LE) | timestamp (32-bit LE, us) | body | crc32 (LE)
+ *
+ * A TELEMETRY_DATA body holds one 32-bit LE value per variable, a
+ * TELEMETRY_SCHEMA body holds the variable names separated by commas. The
+ * CRC is the standard CRC-32 (zlib) over type..body, computed by the CRC
+ * peripheral. Tools/telemetry_csv.py turns the stream into CSV.
+ */
+
+#define TELEMETRY_SYNC   0xA7U // Next to the log frame sync bytes (log.h)
+#define TELEMETRY_SCHEMA 0x01U
+#define TELEMETRY_DATA   0x02U
+
+#ifndef TELEMETRY_MAX_VARS
+#define TELEMETRY_MAX_VARS     16U
+#endif
+
+#ifndef TELEMETRY_MAX_RATE_HZ
+#define TELEMETRY_MAX_RATE_HZ  100U
+#endif
+
+#ifndef TELEMETRY_SCHEMA_EVERY
+#define TELEMETRY_SCHEMA_EVERY 100U // Data records between schema repeats, for late readers
+#endif
+
+#ifndef TELEMETRY_SLOW_DIVIDER
+#define TELEMETRY_SLOW_DIVIDER 10U  // TELEMETRY_SLOW variables are read on every 10th sample
+#endif
+
+#define TELEMETRY_SLOW 0x01U // Expensive reader (e.g. a stack scan), sample it less often
+
+typedef uint32_t (*telemetry_reader)(const void *arg);
+
+typedef struct
+{
+	uint32_t records;      // Data records sent
+	uint32_t dropped;      // Frames the console had no room for, dropped whole
+	uint32_t encode_last;  // Microseconds to sample, encode and queue the last record
+	uint32_t encode_max;
+	uint32_t encode_total; // Divide by records, times the rate, for the CPU share
+} TelemetryProfiler;
+
+extern TelemetryProfiler TelemetryStats;
+
+void telemetry_init(void);
+int telemetry_register(const char *name, telemetry_reader read, const void *arg, uint8_t flags);
+int telemetry_register_u32(const char *name, const volatile uint32_t *value);
+void telemetry_set_rate(uint32_t hz);
+uint32_t telemetry_get_rate(void);
+void vTelemetryTask(void *pvParameters);
+
+// Readers for common kernel values, arg is the queue or task handle
+uint32_t telemetry_read_heap_free(const void *arg);
+uint32_t telemetry_read_queue_fill(const void *arg);
+uint32_t telemetry_read_stack_free(const void *arg);
+
+#endif /* INC_TELEMETRY_H_ */
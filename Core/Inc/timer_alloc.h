@@ -0,0 +1,96 @@
+/*
+ * timer_alloc.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_TIMER_ALLOC_H_
+#define INC_TIMER_ALLOC_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "stm32g071xx.h"
+
+/*
+ * Owner of every general-purpose timer. The table below is the one place a
+ * timer is given to a driver; the build fails when two drivers get the same
+ * timer. At init each driver claims its timer (counter, prescaler, reload,
+ * i.e. the time base) and the capture/compare channels it drives, and the
+ * claim fails when another owner holds any of them, so a driver can no
+ * longer reprogram a timer someone else depends on. A successful claim also
+ * enables the timer clock.
+ *
+ * timer_clock_hz() is the one place the kernel clock of a timer is worked
+ * out: PCLK, doubled when the APB prescaler is not 1, or PLLQ for TIM1/TIM15
+ * when selected in RCC_CCIPR.
+ */
+
+#define TIMER_TIM1  0U
+#define TIMER_TIM2  1U
+#define TIMER_TIM3  2U
+#define TIMER_TIM6  3U
+#define TIMER_TIM7  4U
+#define TIMER_TIM14 5U
+#define TIMER_TIM15 6U
+#define TIMER_TIM16 7U
+#define TIMER_TIM17 8U
+#define TIMER_COUNT 9U
+
+// Timer of each driver
+#define TIMER_FOR_HAL_TICK  TIMER_TIM17 // HAL_GetTick(), 1 kHz update interrupt
+#define TIMER_FOR_TIMESTAMP TIMER_TIM2  // 32-bit microsecond counter
+#define TIMER_FOR_BAM       TIMER_TIM6
+#define TIMER_FOR_WAVEFORM  TIMER_TIM7
+#define TIMER_FOR_PWM       TIMER_TIM1  // PC11 (blue LED) has no other timer channel than TIM1_CH4, PC10 (green) is TIM1_CH3
+#define TIMER_FOR_PWM_RED   TIMER_TIM14 // PC12 (red LED), TIM14_CH1 is its only timer channel
+#define TIMER_FOR_BUTTON    TIMER_TIM16 // One-shot debounce and gesture deadlines
+
+#define TIMER_BIT(t) (1UL << (t))
+#if (TIMER_BIT(TIMER_FOR_HAL_TICK) | TIMER_BIT(TIMER_FOR_TIMESTAMP) | TIMER_BIT(TIMER_FOR_BAM) \
+		| TIMER_BIT(TIMER_FOR_WAVEFORM) | TIMER_BIT(TIMER_FOR_PWM) | TIMER_BIT(TIMER_FOR_PWM_RED) \
+		| TIMER_BIT(TIMER_FOR_BUTTON)) \
+	!= (TIMER_BIT(TIMER_FOR_HAL_TICK) + TIMER_BIT(TIMER_FOR_TIMESTAMP) + TIMER_BIT(TIMER_FOR_BAM) \
+		+ TIMER_BIT(TIMER_FOR_WAVEFORM) + TIMER_BIT(TIMER_FOR_PWM) + TIMER_BIT(TIMER_FOR_PWM_RED) \
+		+ TIMER_BIT(TIMER_FOR_BUTTON))
+#error "Two drivers are assigned the same timer in timer_alloc.h"
+#endif
+
+// Parts of a timer that can be claimed
+#define TIMER_PART_BASE 0x01U // CR1, PSC, ARR, CNT, update event
+#define TIMER_PART_CH1  0x02U
+#define TIMER_PART_CH2  0x04U
+#define TIMER_PART_CH3  0x08U
+#define TIMER_PART_CH4  0x10U
+#define TIMER_PARTS     5U
+
+typedef enum
+{
+	TIMER_OWNER_NONE = 0,
+	TIMER_OWNER_HAL_TICK,
+	TIMER_OWNER_TIMESTAMP,
+	TIMER_OWNER_BAM,
+	TIMER_OWNER_WAVEFORM,
+	TIMER_OWNER_PWM,
+	TIMER_OWNER_BUTTON,
+	TIMER_OWNER_COUNT
+} timer_owner;
+
+typedef struct
+{
+	uint32_t claims;
+	uint32_t conflicts;
+	uint8_t conflict_timer;  // Last refused claim
+	uint8_t conflict_owner;  // Who asked
+	uint8_t conflict_holder; // Who had it
+} TimerAllocProfiler;
+
+extern TimerAllocProfiler TimerAllocStats;
+extern const char *const timer_owner_names[TIMER_OWNER_COUNT];
+
+int timer_claim(uint8_t timer, uint8_t parts, timer_owner owner);
+timer_owner timer_get_owner(uint8_t timer, uint8_t part);
+const char *timer_name(uint8_t timer);
+uint32_t timer_clock_hz(uint8_t timer);
+
+#endif /* INC_TIMER_ALLOC_H_ */
@@ -0,0 +1,23 @@
+/*
+ * timestamp.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_TIMESTAMP_H_
+#define INC_TIMESTAMP_H_
+
+#include "main.h"
+#include "stm32g071xx.h"
+
+#define TIMESTAMP_HZ 1000000U // TIM2 counts microseconds, wraps after ~71 minutes
+
+void timestamp_init(void);
+
+// Safe from any context, a single 32-bit register read
+static inline uint32_t timestamp_now(void)
+{
+	return TIM2->CNT;
+}
+
+#endif /* INC_TIMESTAMP_H_ */
@@ -0,0 +1,50 @@
+/*
+ * uart_fifo.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_UART_FIFO_H_
+#define INC_UART_FIFO_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+
+/*
+ * USART2 driver for CONSOLE_BACKEND_FIFO, built on the LL USART API. Both
+ * 8-byte hardware FIFOs are enabled, so one interrupt moves a whole batch:
+ *
+ *   TX: the TX FIFO threshold interrupt (FIFO empty) refills up to 8 bytes
+ *       from the console ring and is masked again once the ring is empty.
+ *   RX: the RX FIFO threshold interrupt (6 of 8 bytes) or the receiver
+ *       timeout (UART_FIFO_RX_TIMEOUT bit times of idle line) drains the
+ *       FIFO into the shell stream buffer.
+ */
+
+#define UART_FIFO_DEPTH 8U
+
+#ifndef UART_FIFO_RX_TIMEOUT
+#define UART_FIFO_RX_TIMEOUT 20U // Bit times, two characters at 8N1
+#endif
+
+typedef struct
+{
+	uint32_t irq_count;    // USART2 interrupts taken
+	uint32_t tx_refills;   // TX threshold events that queued at least one byte
+	uint32_t tx_bytes;
+	uint32_t rx_drains;    // RX threshold or receiver timeout events
+	uint32_t rx_bytes;
+	uint32_t rx_overruns;
+	uint32_t isr_cycles;   // Total CPU cycles spent in uart_fifo_irq_handler()
+} UartFifoProfiler;
+
+extern UartFifoProfiler UartFifoStats;
+
+void uart_fifo_start_rx(void);
+void uart_fifo_tx_kick(void);
+void uart_fifo_irq_handler(void);
+
+#endif /* INC_UART_FIFO_H_ */
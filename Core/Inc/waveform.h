@@ -0,0 +1,50 @@
+/*
+ * waveform.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INC_WAVEFORM_H_
+#define INC_WAVEFORM_H_
+
+#include <stdint.h>
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "stm32g071xx.h"
+#include "pattern_vm.h"
+
+/*
+ * LED pattern playback on TIM7. waveform_run() plays a pattern_vm program:
+ * each update interrupt runs the interpreter up to its next hold and loads
+ * that hold into ARR (not preloaded, the counter has just restarted), so
+ * edges are timed by the timer and not by the scheduler. The caller gets
+ * one task notification when the program ends.
+ *
+ * The G0 DMA cannot reach GPIOC (the GPIO ports sit on the Cortex-M0+
+ * IOPORT bus), which is why the outputs are written by an interrupt.
+ */
+
+#ifndef WAVEFORM_TICK_US
+#define WAVEFORM_TICK_US 100U // Hold length unit, ARR counts up to 6.5 s
+#endif
+
+#define WAVEFORM_MS(ms) ((uint16_t)(((ms) * 1000U) / WAVEFORM_TICK_US))
+
+typedef struct
+{
+	uint32_t vm_steps;        // pattern_vm_run() calls from the TIM7 interrupt
+	uint32_t vm_cycles_last;  // CPU cycles of the last call
+	uint32_t vm_cycles_max;
+	uint32_t vm_cycles_total; // Divide by vm_steps for the average
+} WaveformProfiler;
+
+extern WaveformProfiler WaveformStats;
+
+void waveform_init(void);
+int waveform_run(pattern_vm *vm, TaskHandle_t notify);
+void waveform_stop(void);
+uint8_t waveform_busy(void);
+uint8_t waveform_ended(uint32_t *end_us);
+
+#endif /* INC_WAVEFORM_H_ */
@@ -24,7 +24,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-
+#include "log.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -54,6 +54,9 @@
 
 /* Private application code --------------------------------------------------*/
 /* USER CODE BEGIN Application */
-
+void vApplicationMallocFailedHook(void)
+{
+	LOG_ERROR(KERNEL, "pvPortMalloc failed, %u bytes of heap free\n\r", xPortGetFreeHeapSize());
+}
 /* USER CODE END Application */
 
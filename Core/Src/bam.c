@@ -0,0 +1,155 @@
+//TIM6 - bit-angle modulation of GPIOC LEDs, see bam.h
+
+#include "bam.h"
+#include "timer_alloc.h"
+#include "clock.h"
+#include "log.h"
+
+// Two sets of slot words, the ISR plays the active one. Level changes go to
+// the other set, which is swapped in at the next frame.
+static uint32_t bam_bsrr[2][BAM_BITS];
+static volatile uint8_t bam_active;
+static volatile uint8_t bam_pending; // Other set holds changes, swap at the next frame
+static uint8_t bam_bit;              // Slot the next update interrupt starts
+static uint16_t bam_pins;            // Pins driven by the words
+static uint8_t bam_ok;               // TIM6 claimed
+
+// The preloaded PSC takes over at the next slot, that slot alone has the wrong length
+static void bam_clock_changed(clock_event event)
+{
+	if(event == CLOCK_AFTER)
+	{
+		TIM6->PSC = (timer_clock_hz(TIMER_FOR_BAM) / 1000000U) - 1U;
+	}
+}
+
+void bam_init(void)
+{
+	if(timer_claim(TIMER_FOR_BAM, TIMER_PART_BASE, TIMER_OWNER_BAM) != 0)
+	{
+		LOG_ERROR(LED, "TIM6 already claimed, no bit-angle modulation\n\r");
+		return;
+	}
+
+	uint32_t timer_clock = timer_clock_hz(TIMER_FOR_BAM);
+
+	TIM6->CR1 = TIM_CR1_ARPE | TIM_CR1_URS;          // ARR is preloaded, UG raises no interrupt
+	TIM6->PSC = (timer_clock / 1000000U) - 1U;       // 1 MHz counter clock
+	TIM6->DIER = TIM_DIER_UIE;
+
+	// Highest priority, a late interrupt stretches a slot. No kernel calls in the ISR.
+	NVIC_SetPriority(TIM6_DAC_LPTIM1_IRQn, 0);
+	NVIC_EnableIRQ(TIM6_DAC_LPTIM1_IRQn);
+
+	clock_register(bam_clock_changed);
+	bam_ok = 1;
+}
+
+static void bam_start(void)
+{
+	bam_bit = 0;
+	TIM6->ARR = BAM_TICK_US - 1U;  // Slot 0 length, the first update plays slot 0
+	TIM6->CNT = 0;
+	TIM6->EGR = TIM_EGR_UG;
+	TIM6->SR = 0;
+	TIM6->CR1 |= TIM_CR1_CEN;
+}
+
+// The set that collects changes, a copy of the active one if nothing is
+// pending yet. Critical section.
+static uint32_t *bam_next_words(void)
+{
+	uint32_t *next = bam_bsrr[bam_active ^ 1U];
+
+	if(!bam_pending)
+	{
+		for(uint32_t bit = 0; bit < BAM_BITS; bit++)
+		{
+			next[bit] = bam_bsrr[bam_active][bit];
+		}
+		bam_pending = 1;
+	}
+	return next;
+}
+
+// Level 0..999 for the pins in pin_mask, from the next frame. Pins not driven
+// yet are taken over.
+void bam_set(uint16_t pin_mask, uint16_t brightness)
+{
+	if(!bam_ok || pin_mask == 0U)
+	{
+		return;
+	}
+	if(brightness > BAM_BRIGHTNESS_MAX)
+	{
+		brightness = BAM_BRIGHTNESS_MAX; // Cap brightness at 100%
+	}
+
+	uint32_t level = (brightness * 255U + (BAM_BRIGHTNESS_MAX / 2U)) / BAM_BRIGHTNESS_MAX;
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint32_t *next = bam_next_words();
+
+	for(uint32_t bit = 0; bit < BAM_BITS; bit++)
+	{
+		uint32_t on = (level & (1U << bit)) ? pin_mask : 0U;
+
+		next[bit] = (next[bit] & ~(((uint32_t)pin_mask << 16) | pin_mask)) | ((uint32_t)(pin_mask & ~on) << 16) | on;
+	}
+	bam_pins |= pin_mask;
+	if((TIM6->CR1 & TIM_CR1_CEN) == 0U)
+	{
+		bam_active ^= 1U; // Nothing plays yet, use the new set right away
+		bam_pending = 0;
+		bam_start();
+	}
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// Stops driving the pins in pin_mask at once; they keep their last state.
+// TIM6 stops with the last pin.
+void bam_release(uint16_t pin_mask)
+{
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+	pin_mask &= bam_pins;
+	if(pin_mask != 0U)
+	{
+		uint32_t keep = ~(((uint32_t)pin_mask << 16) | pin_mask);
+
+		for(uint32_t bit = 0; bit < BAM_BITS; bit++)
+		{
+			bam_bsrr[0][bit] &= keep;
+			bam_bsrr[1][bit] &= keep;
+		}
+		bam_pins &= ~pin_mask;
+		if(bam_pins == 0U)
+		{
+			TIM6->CR1 &= ~TIM_CR1_CEN;
+		}
+	}
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+uint16_t bam_driven(void)
+{
+	return bam_pins;
+}
+
+void TIM6_DAC_LPTIM1_IRQHandler(void)
+{
+	uint8_t bit = bam_bit;
+
+	TIM6->SR = 0;
+
+	// This update started slot "bit", its length was preloaded by the previous interrupt
+	GPIOC->BSRR = bam_bsrr[bam_active][bit];
+
+	bit = (bit + 1U) & (BAM_BITS - 1U);
+	if(bit == 0U && bam_pending)
+	{
+		bam_active ^= 1U;
+		bam_pending = 0;
+	}
+	TIM6->ARR = (BAM_TICK_US << bit) - 1U;
+	bam_bit = bit;
+}
@@ -1,59 +1,401 @@
 #include "button.h"
+#include "timestamp.h"
+#include "timer_alloc.h"
+#include "clock.h"
+#include "latency.h"
+
+typedef enum
+{
+	GESTURE_IDLE = 0,
+	GESTURE_PRESSED,  // Down, waiting for the long press
+	GESTURE_HELD,     // Long press reported, repeating
+	GESTURE_RELEASED  // One click, waiting for a second one
+} gesture_state;
+
+typedef struct
+{
+	const button_config *config;
+	uint32_t debounce_at; // End of the debounce, while debouncing
+	uint32_t gesture_at;  // Next gesture deadline, while timing
+	uint32_t edge_us;     // First edge of the last debounce
+	uint16_t repeats;
+	uint8_t debouncing;   // EXTI line masked
+	uint8_t timing;
+	uint8_t pressed;      // Stable level
+	uint8_t state;        // gesture_state
+	uint8_t clicks;
+} button_state;
+
+static button_state buttons[BUTTON_MAX];
+static uint8_t button_count;
+static uint16_t button_lines; // EXTI lines of all buttons
+static uint8_t button_timer_ok;
+static QueueHandle_t xButtonEvents;
 
 TaskHandle_t xButtonTaskHandle = NULL;
+ButtonProfiler ButtonStats;
+
+const char *const button_event_names[BUTTON_EVENT_COUNT] =
+{
+	"click", "double-click", "long-press", "repeat", "hold-end"
+};
+
+#define BUTTON_US(ms) ((uint32_t)(ms) * 1000U)
+#define BUTTON_TIMER_US (1000000U / BUTTON_TIMER_HZ)
+
+static uint8_t button_level(const button_config *config)
+{
+	uint8_t high = (config->port->IDR & (1U << config->pin)) != 0U;
+
+	return config->active_low ? !high : high;
+}
+
+// Interrupt context. EXTI4_15 and TIM16 have the same priority, so the
+// button state is only ever touched by one of them at a time.
+static void button_send(uint8_t index, button_event_type type, uint16_t count, uint32_t time_us, BaseType_t *woken)
+{
+	button_event event = { index, (uint8_t)type, count, time_us, timestamp_now() };
+
+	ButtonStats.events[type]++;
+	if(xButtonEvents == NULL || xQueueSendFromISR(xButtonEvents, &event, woken) != pdTRUE)
+	{
+		ButtonStats.dropped++;
+		LOG_IF(BUTTON, LOG_LEVEL_WARN, ISR_LOG(ISR_LOG_CH_BUTTON, "Button event %u dropped\n\r", type));
+	}
+}
+
+static void button_idle(button_state *b)
+{
+	b->state = GESTURE_IDLE;
+	b->clicks = 0;
+	b->timing = 0;
+}
+
+// Times are taken from the first edge, so the debounce does not stretch them
+static void button_pressed(button_state *b)
+{
+	b->state = GESTURE_PRESSED;
+	b->timing = (b->config->long_press_ms != 0U);
+	b->gesture_at = b->edge_us + BUTTON_US(b->config->long_press_ms);
+}
+
+static void button_released(uint8_t index, BaseType_t *woken)
+{
+	button_state *b = &buttons[index];
+
+	if(b->state == GESTURE_HELD)
+	{
+		button_send(index, BUTTON_HOLD_END, b->repeats, b->edge_us, woken);
+		button_idle(b);
+		return;
+	}
+	if(b->state != GESTURE_PRESSED)
+	{
+		return; // Press seen before the button was added
+	}
+
+	b->clicks++;
+	if(b->clicks >= 2U)
+	{
+		button_send(index, BUTTON_DOUBLE_CLICK, 2, b->edge_us, woken);
+		button_idle(b);
+	}
+	else if(b->config->double_click_ms == 0U)
+	{
+		button_send(index, BUTTON_CLICK, 1, b->edge_us, woken);
+		button_idle(b);
+	}
+	else
+	{
+		b->state = GESTURE_RELEASED;
+		b->timing = 1;
+		b->gesture_at = b->edge_us + BUTTON_US(b->config->double_click_ms);
+	}
+}
+
+// A gesture deadline has passed
+static void button_deadline(uint8_t index, uint32_t now, BaseType_t *woken)
+{
+	button_state *b = &buttons[index];
+	uint32_t repeat_us = BUTTON_US(b->config->repeat_ms);
+
+	switch(b->state)
+	{
+		case GESTURE_PRESSED:
+			if(b->clicks != 0U)
+			{
+				button_send(index, BUTTON_CLICK, 1, b->edge_us, woken); // Click, then press and hold
+			}
+			button_send(index, BUTTON_LONG_PRESS, 1, b->gesture_at, woken);
+			b->state = GESTURE_HELD;
+			b->repeats = 0;
+			b->timing = (repeat_us != 0U);
+			b->gesture_at += repeat_us;
+			break;
+
+		case GESTURE_HELD:
+			b->repeats++;
+			button_send(index, BUTTON_REPEAT, b->repeats, b->gesture_at, woken);
+			b->gesture_at += repeat_us;
+			if((int32_t)(now - b->gesture_at) >= 0)
+			{
+				b->gesture_at = now + repeat_us; // Held off, no burst of repeats
+			}
+			break;
+
+		case GESTURE_RELEASED:
+			button_send(index, BUTTON_CLICK, 1, b->edge_us, woken); // The release, not the end of the window
+			button_idle(b);
+			break;
+
+		default:
+			b->timing = 0;
+			break;
+	}
+}
 
-void button_gpio_init(void)
+// Masks the line and starts the debounce of a button
+static void button_debounce(button_state *b, uint32_t now)
 {
-	// Enable GPIOC clock
-	RCC->IOPENR |= RCC_IOPENR_GPIOCEN;
+	EXTI->IMR1 &= ~(1UL << b->config->pin);
+	b->debouncing = 1;
+	b->debounce_at = now + BUTTON_US(b->config->debounce_ms);
+	b->edge_us = now;
+	ButtonStats.edges++;
+}
 
-	// Configure PC13 as input
-	GPIOC->MODER &= ~(3U << (2*13));  // Clear mode bits for PC13 (input mode)
-	GPIOC->PUPDR &= ~(3U << (2*13)); // Clear pull-up/pull-down bits for PC13
-	GPIOC->PUPDR |= (1U << (2*13));   // PC13 pull-up resistor enabled.
+// The debounce time is over: sample, then listen to the line again
+static void button_debounced(uint8_t index, uint32_t now, BaseType_t *woken)
+{
+	button_state *b = &buttons[index];
+	uint32_t line = 1UL << b->config->pin;
+	uint8_t level = button_level(b->config);
 
-	//Interrupt configuration
-	RCC->APBENR2 |= RCC_APBENR2_SYSCFGEN; // Enable SYSCFG clock
+	latency_add(LATENCY_DEBOUNCE, now - b->edge_us);
+	b->debouncing = 0;
+	if(level == b->pressed)
+	{
+		ButtonStats.glitches++;
+	}
+	else
+	{
+		b->pressed = level;
+		if(level)
+		{
+			button_pressed(b);
+		}
+		else
+		{
+			button_released(index, woken);
+		}
+	}
 
-	// Connect EXTI13 line to PC13
-	EXTI->EXTICR[3] &= ~(0x7U << 8);     // Clear EXTI13 bits
-	EXTI->EXTICR[3] |= (2U << 8);   // Set EXTI13 to port C (0100)
-	EXTI->IMR1 |= (1U << 13);       // Unmask EXTI13
-	EXTI->FTSR1 |= (1U << 13);      // Trigger on falling edge
-	EXTI->RTSR1 &= ~(1U << 13);     // Disable rising edge trigger
+	EXTI->RPR1 = line;
+	EXTI->FPR1 = line;
+	EXTI->IMR1 |= line;
 
+	// A change while the line was masked left no edge to wake us
+	if(button_level(b->config) != b->pressed)
+	{
+		button_debounce(b, now);
+	}
+}
+
+// Arms the one-shot timer for the earliest deadline of all buttons, or
+// leaves it stopped when there is none. Rounded up by up to two timer
+// counts; a wait past the 16-bit range fires early and arms again.
+static void button_arm(uint32_t now)
+{
+	uint32_t wait = UINT32_MAX;
+
+	for(uint32_t i = 0; i < button_count; i++)
+	{
+		button_state *b = &buttons[i];
+		int32_t left;
+
+		if(b->debouncing)
+		{
+			left = (int32_t)(b->debounce_at - now);
+			wait = (left <= 0) ? 0U : ((uint32_t)left < wait ? (uint32_t)left : wait);
+		}
+		if(b->timing)
+		{
+			left = (int32_t)(b->gesture_at - now);
+			wait = (left <= 0) ? 0U : ((uint32_t)left < wait ? (uint32_t)left : wait);
+		}
+	}
+
+	TIM16->CR1 &= ~TIM_CR1_CEN;
+	if(wait == UINT32_MAX)
+	{
+		return;
+	}
+
+	uint32_t counts = wait / BUTTON_TIMER_US + 2U; // ARR 0 would block the counter
+
+	TIM16->ARR = (counts > 0xFFFFU) ? 0xFFFFU : counts - 1U;
+	TIM16->CNT = 0;
+	TIM16->EGR = TIM_EGR_UG; // Loads the prescaler, URS keeps it from interrupting
+	TIM16->CR1 |= TIM_CR1_CEN; // One-pulse mode clears CEN at the update
+}
+
+// New prescaler after a clock switch, the pending deadline is armed again at the new rate
+static void button_clock_changed(clock_event event)
+{
+	if(event != CLOCK_AFTER || !button_timer_ok)
+	{
+		return;
+	}
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint8_t running = (TIM16->CR1 & TIM_CR1_CEN) != 0U;
+
+	TIM16->PSC = (timer_clock_hz(TIMER_FOR_BUTTON) / BUTTON_TIMER_HZ) - 1U;
+	if(running)
+	{
+		button_arm(timestamp_now());
+	}
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// Event queue and the one-shot timer, before button_add()
+void button_init(void)
+{
+	RCC->APBENR2 |= RCC_APBENR2_SYSCFGEN; // EXTICR
+	xButtonEvents = xQueueCreate(BUTTON_EVENT_QUEUE_LEN, sizeof(button_event));
+
+	if(timer_claim(TIMER_FOR_BUTTON, TIMER_PART_BASE, TIMER_OWNER_BUTTON) != 0)
+	{
+		LOG_ERROR(BUTTON, "TIM16 already claimed, no buttons\n\r");
+		return;
+	}
+
+	TIM16->CR1 = TIM_CR1_OPM | TIM_CR1_URS; // One shot, UG raises no interrupt
+	TIM16->PSC = (timer_clock_hz(TIMER_FOR_BUTTON) / BUTTON_TIMER_HZ) - 1U;
+	TIM16->DIER = TIM_DIER_UIE;
+	button_timer_ok = 1;
+
+	clock_register(button_clock_changed);
+}
+
+// Configures the pin as an input with its pull resistor and both edges of
+// its EXTI line. Returns the button index, -1 when the table is full, the
+// line is out of 4..15 or taken, or the timer is missing.
+int button_add(const button_config *config)
+{
+	uint32_t line = 1UL << config->pin;
+	uint32_t port = ((uint32_t)config->port - GPIOA_BASE) / 0x400U; // EXTICR port code, A = 0
+	uint32_t shift = 8U * (config->pin % 4U);
+
+	if(!button_timer_ok || button_count >= BUTTON_MAX || config->pin < 4U || config->pin > 15U
+			|| (button_lines & line) != 0U || config->debounce_ms == 0U || config->debounce_ms > 100U || port > 5U)
+	{
+		return -1;
+	}
+
+	RCC->IOPENR |= 1UL << port;
+	config->port->MODER &= ~(3UL << (2U * config->pin));               // Input
+	config->port->PUPDR &= ~(3UL << (2U * config->pin));
+	config->port->PUPDR |= (config->active_low ? 1UL : 2UL) << (2U * config->pin); // Pull-up, or pull-down when active high
+
+	EXTI->EXTICR[config->pin / 4U] = (EXTI->EXTICR[config->pin / 4U] & ~(0xFFUL << shift)) | (port << shift);
+	EXTI->FTSR1 |= line; // Both edges, the debounce samples the level
+	EXTI->RTSR1 |= line;
+
+	button_state *b = &buttons[button_count];
+
+	b->config = config;
+	b->debouncing = 0;
+	b->pressed = button_level(config);
+	button_idle(b);
+	button_lines |= (uint16_t)line;
+
+	EXTI->RPR1 = line;
+	EXTI->FPR1 = line;
+	EXTI->IMR1 |= line;
+	return button_count++;
+}
+
+const button_config *button_get(uint8_t button)
+{
+	return (button < button_count) ? buttons[button].config : NULL;
 }
 
 void button_enable_interrupt(void)
 {
-	// Clear any pending interrupt flag for EXTI13
-	EXTI->FPR1 |= (1U << 13);       // Clear pending flag by writing 1
-	NVIC_SetPriority(EXTI4_15_IRQn, 5); // Set priority (5 is suitable for FreeRTOS)
-	NVIC_EnableIRQ(EXTI4_15_IRQn);      // Enable EXTI4_15 interrupt in NVIC
+	// Same priority for both, they share the button state. The M0+ NVIC has
+	// 2 priority bits (0..3); 3 is the lowest, like USART2 and the DMA.
+	NVIC_SetPriority(EXTI4_15_IRQn, 3);
+	NVIC_SetPriority(TIM16_IRQn, 3);
+	NVIC_EnableIRQ(EXTI4_15_IRQn);
+	NVIC_EnableIRQ(TIM16_IRQn);
 }
 
+// Blocks for the next gesture of any button, pdFALSE on timeout
+BaseType_t button_get_event(button_event *event, TickType_t timeout)
+{
+	if(xButtonEvents == NULL)
+	{
+		vTaskDelay(timeout);
+		return pdFALSE;
+	}
+	if(xQueueReceive(xButtonEvents, event, timeout) != pdTRUE)
+	{
+		return pdFALSE;
+	}
+	latency_since(LATENCY_RECEIVE, event->sent_us);
+	return pdTRUE;
+}
 
+// Debounced level of the first button
 uint8_t is_button_pressed(void)
 {
-	// Return 1 if button is pressed (active low), otherwise return 0
-	return (GPIOC->IDR & (1U << 13)) == 0;
+	return (button_count > 0U) ? buttons[0].pressed : 0U;
 }
 
+// First edge of a debounce: mask the line, the timer does the rest
 void EXTI4_15_IRQHandler(void)
 {
-	if(EXTI->FPR1 & (1U << 13)) // Check if EXTI13 triggered the interrupt
+	uint32_t pending = (EXTI->FPR1 | EXTI->RPR1) & button_lines;
+	uint32_t now = timestamp_now();
+
+	EXTI->FPR1 = pending; // Write 1 to clear, only the lines handled here
+	EXTI->RPR1 = pending;
+
+	for(uint32_t i = 0; i < button_count; i++)
 	{
-		EXTI->FPR1 |= (1U << 13); // Clear the pending interrupt flag by writing 1
+		button_state *b = &buttons[i];
 
-		if(xButtonTaskHandle != NULL)
+		if((pending & (1UL << b->config->pin)) != 0U && !b->debouncing)
 		{
-		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-		vTaskNotifyGiveFromISR(xButtonTaskHandle, &xHigherPriorityTaskWoken);
-		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+			button_debounce(b, now);
 		}
-		else
+	}
+	button_arm(now);
+}
+
+// Debounce ends and gesture deadlines, each button handled once
+void TIM16_IRQHandler(void)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	uint32_t now = timestamp_now();
+
+	TIM16->SR = 0;
+	ButtonStats.timer_irqs++;
+
+	for(uint8_t i = 0; i < button_count; i++)
+	{
+		button_state *b = &buttons[i];
+
+		if(b->debouncing && (int32_t)(now - b->debounce_at) >= 0)
+		{
+			button_debounced(i, now, &xHigherPriorityTaskWoken);
+		}
+		if(b->timing && (int32_t)(now - b->gesture_at) >= 0)
 		{
-			printf("Button ISR: xButtonTaskHandle is NULL!\n\r");
+			button_deadline(i, now, &xHigherPriorityTaskWoken);
 		}
 	}
+	button_arm(now);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
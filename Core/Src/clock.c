@@ -0,0 +1,229 @@
+//RCC clock profiles and the driver notification around a switch, see clock.h
+
+#include "clock.h"
+#include "cmsis_os.h"
+#include "timestamp.h"
+#include "log.h"
+
+const char *const clock_profile_names[CLOCK_PROFILE_COUNT] = { "hsi16", "pll64", "lprun" };
+
+static clock_notify notifiers[CLOCK_MAX_NOTIFY];
+static uint8_t notifier_count;
+static clock_profile profile_now = CLOCK_PROFILE_HSI16; // What SystemClock_Config() sets
+
+ClockProfiler ClockStats;
+
+// Called from init code, before the scheduler or from one task, so there is no lock
+// A notifier already registered is not added again, so a driver whose init
+// runs twice is still called once per event
+int clock_register(clock_notify notify)
+{
+	if(notify == NULL)
+	{
+		return -1;
+	}
+	for(uint8_t i = 0; i < notifier_count; i++)
+	{
+		if(notifiers[i] == notify)
+		{
+			return 0;
+		}
+	}
+	if(notifier_count >= CLOCK_MAX_NOTIFY)
+	{
+		return -1;
+	}
+	notifiers[notifier_count++] = notify;
+	return 0;
+}
+
+clock_profile clock_get_profile(void)
+{
+	return profile_now;
+}
+
+static void clock_notify_all(clock_event event)
+{
+	for(uint8_t i = 0; i < notifier_count; i++)
+	{
+		notifiers[i](event);
+	}
+}
+
+// Back to 16 MHz HSI with the PLL off and 0 wait states, where every profile starts
+static int clock_to_hsi16(void)
+{
+	RCC_OscInitTypeDef osc = {0};
+	RCC_ClkInitTypeDef clk = {0};
+
+	// Low-power run allows 2 MHz at most, leave it before speeding up
+	if(READ_BIT(PWR->CR1, PWR_CR1_LPR) != 0U && HAL_PWREx_DisableLowPowerRunMode() != HAL_OK)
+	{
+		return -1;
+	}
+
+	// HSI16 stays the PLL input, so HSIDIV is still 1 on pll64. ClockConfig()
+	// drops the wait states after the switch.
+	if(__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_HSI)
+	{
+		clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1;
+		clk.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+		clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+		clk.APB1CLKDivider = RCC_HCLK_DIV1;
+		if(HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_0) != HAL_OK)
+		{
+			return -1;
+		}
+	}
+
+	osc.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+	osc.HSIState = RCC_HSI_ON;
+	osc.HSIDiv = RCC_HSI_DIV1;
+	osc.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+	osc.PLL.PLLState = RCC_PLL_OFF;
+	return (HAL_RCC_OscConfig(&osc) == HAL_OK) ? 0 : -1;
+}
+
+// 16 MHz / M 1 * N 8 = 128 MHz VCO, / R 2 = 64 MHz, the G071 maximum at range 1
+static int clock_to_pll64(void)
+{
+	RCC_OscInitTypeDef osc = {0};
+	RCC_ClkInitTypeDef clk = {0};
+
+	osc.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+	osc.PLL.PLLState = RCC_PLL_ON;
+	osc.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+	osc.PLL.PLLM = RCC_PLLM_DIV1;
+	osc.PLL.PLLN = 8;
+	osc.PLL.PLLP = RCC_PLLP_DIV2;
+#if defined(RCC_PLLQ_SUPPORT)
+	osc.PLL.PLLQ = RCC_PLLQ_DIV2;
+#endif
+	osc.PLL.PLLR = RCC_PLLR_DIV2;
+	if(HAL_RCC_OscConfig(&osc) != HAL_OK)
+	{
+		return -1;
+	}
+
+	// Two wait states above 48 MHz, set by ClockConfig() before the switch
+	clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1;
+	clk.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+	clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	clk.APB1CLKDivider = RCC_HCLK_DIV1;
+	if(HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_2) != HAL_OK)
+	{
+		return -1;
+	}
+
+	// The wait states are mostly hidden by these, HAL_Init() sets them from
+	// stm32g0xx_hal_conf.h but the profile does not depend on it
+	__HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+	__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+	return 0;
+}
+
+// HSI16 / 8 = 2 MHz, the low-power run limit, then the regulator in low-power mode
+static int clock_to_lprun(void)
+{
+	RCC_OscInitTypeDef osc = {0};
+
+	osc.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+	osc.HSIState = RCC_HSI_ON;
+	osc.HSIDiv = RCC_HSI_DIV8;
+	osc.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+	osc.PLL.PLLState = RCC_PLL_NONE;
+	if(HAL_RCC_OscConfig(&osc) != HAL_OK)
+	{
+		return -1;
+	}
+
+	HAL_PWREx_EnableLowPowerRunMode();
+	return 0;
+}
+
+static int clock_apply(clock_profile profile)
+{
+	if(clock_to_hsi16() != 0)
+	{
+		return -1;
+	}
+
+	switch(profile)
+	{
+		case CLOCK_PROFILE_PLL64:
+			return clock_to_pll64();
+
+		case CLOCK_PROFILE_LPRUN:
+			return clock_to_lprun();
+
+		default:
+			return 0;
+	}
+}
+
+// Task context, or main() before the scheduler starts. Returns -1 when the
+// profile is unknown or RCC refused it; the clock is then on hsi16 if that
+// much worked, and the drivers have been told either way.
+int clock_set_profile(clock_profile profile)
+{
+	if(profile >= CLOCK_PROFILE_COUNT)
+	{
+		return -1;
+	}
+
+	uint8_t running = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+	uint32_t systick_on = SysTick->CTRL & SysTick_CTRL_ENABLE_Msk; // Off until the scheduler starts
+	int result;
+
+	// Slow work (draining the console) is done here, not with the scheduler
+	// suspended; it does not count in switch_us
+	clock_notify_all(CLOCK_PREPARE);
+
+	uint32_t start = timestamp_now();
+
+	if(running)
+	{
+		vTaskSuspendAll();
+	}
+	clock_notify_all(CLOCK_BEFORE);
+
+	uint32_t stopped = timestamp_now();
+
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	result = clock_apply(profile);
+	if(result != 0)
+	{
+		ClockStats.failures++;
+		clock_apply(CLOCK_PROFILE_HSI16);
+	}
+	SystemCoreClockUpdate();
+	profile_now = (result == 0) ? profile : CLOCK_PROFILE_HSI16;
+
+	// The kernel tick at the new clock, vPortSetupTimerInterrupt() does the same at start
+	SysTick->LOAD = (SystemCoreClock / configTICK_RATE_HZ) - 1U;
+	SysTick->VAL = 0;
+	SysTick->CTRL |= systick_on;
+
+	clock_notify_all(CLOCK_AFTER);
+
+	// TIM2 counts microseconds again once its notifier has run
+	uint32_t end = timestamp_now();
+
+	ClockStats.switches++;
+	ClockStats.switch_us = end - start;
+	ClockStats.hz = SystemCoreClock;
+
+	if(running)
+	{
+		xTaskResumeAll();
+		// Give the kernel back the ticks SysTick missed while it was stopped
+		xTaskCatchUpTicks((TickType_t)((end - stopped) / (1000000U / configTICK_RATE_HZ)));
+	}
+
+	if(result != 0)
+	{
+		LOG_WARN(KERNEL, "Clock profile %s refused, running %s\n\r", clock_profile_names[profile],
+				clock_profile_names[profile_now]);
+	}
+	return result;
+}
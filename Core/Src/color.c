@@ -0,0 +1,41 @@
+//Integer HSV to RGB, see color.h. No HAL or kernel calls.
+
+#include "color.h"
+
+// 0..255 onto 0..999: 1003 / 256 = 3.918, 255 gives 999
+static uint16_t color_level(uint32_t x)
+{
+	return (uint16_t)((x * 1003U) >> 8);
+}
+
+// Hues from COLOR_HUE_MAX on wrap around
+color_rgb color_hsv(uint16_t hue, uint8_t saturation, uint8_t value)
+{
+	while(hue >= COLOR_HUE_MAX)
+	{
+		hue -= COLOR_HUE_MAX;
+	}
+
+	uint32_t sector = hue >> 8;
+	uint32_t frac = hue & (COLOR_HUE_SECTOR - 1U);
+	uint32_t s = saturation + (saturation >> 7); // 0..256, 255 is fully saturated
+	uint32_t v = color_level(value); // Scaled first, the channels below keep the precision
+
+	// Lowest, falling and rising channel of the sextant. v * 65536 < 2^26.
+	uint32_t p = (v * (256U - s)) >> 8;
+	uint32_t q = (v * (65536U - s * frac)) >> 16;
+	uint32_t t = (v * (65536U - s * (COLOR_HUE_SECTOR - frac))) >> 16;
+	uint32_t r, g, b;
+
+	switch(sector)
+	{
+		case 0:  r = v; g = t; b = p; break;
+		case 1:  r = q; g = v; b = p; break;
+		case 2:  r = p; g = v; b = t; break;
+		case 3:  r = p; g = q; b = v; break;
+		case 4:  r = t; g = p; b = v; break;
+		default: r = v; g = p; b = q; break;
+	}
+
+	return (color_rgb){ (uint16_t)r, (uint16_t)g, (uint16_t)b };
+}
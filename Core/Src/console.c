@@ -0,0 +1,402 @@
+// Non-blocking console backend: _write() copies into a RAM ring buffer which
+// is drained by USART2 TX DMA (DMA1 channel 1, routed through DMAMUX) or by
+// the TX FIFO threshold interrupt (uart_fifo.c).
+
+#include "console.h"
+#include "uart_fifo.h"
+#include "clock.h"
+#include "timestamp.h"
+#include "semphr.h"
+
+extern UART_HandleTypeDef huart2;
+int __io_putchar(int ch);
+
+ConsoleProfiler ConsoleStats;
+
+#if CONSOLE_BACKEND != CONSOLE_BACKEND_POLLING
+static uint8_t tx_ring[CONSOLE_TX_BUFFER_SIZE];
+static volatile uint16_t tx_head;  // Next byte to be written by a producer
+static volatile uint16_t tx_tail;  // Oldest byte not yet handed to the hardware
+static uint16_t tx_frame_end;      // End of the last frame queued, overwriting stops there
+#if CONSOLE_BACKEND == CONSOLE_BACKEND_DMA
+static uint8_t tx_chunk[CONSOLE_DMA_CHUNK_SIZE]; // DMA source, the ring only holds pending bytes
+static volatile uint8_t tx_busy;   // DMA transfer in flight
+#endif
+#if CONSOLE_FULL_POLICY == CONSOLE_FULL_BLOCK
+static SemaphoreHandle_t xConsoleSpace;
+#endif
+#endif
+
+static uint8_t in_isr(void)
+{
+	return (__get_IPSR() != 0U);
+}
+
+// Cycle counter built from the kernel tick and the SysTick down-counter
+static uint32_t console_cycles(void)
+{
+	uint32_t ticks, val;
+
+	do
+	{
+		ticks = xTaskGetTickCount();
+		val = SysTick->VAL;
+	} while(ticks != xTaskGetTickCount());
+
+	return ticks * (SysTick->LOAD + 1U) + (SysTick->LOAD - val);
+}
+
+#if CONSOLE_BACKEND == CONSOLE_BACKEND_DMA
+// Must be called with interrupts masked
+static void console_start_tx(void)
+{
+	uint16_t pending = (uint16_t)(tx_head - tx_tail);
+	uint16_t len = 0;
+
+	if(tx_busy && huart2.gState == HAL_UART_STATE_READY)
+	{
+		tx_busy = 0; // Transfer ended by a UART error, no complete callback will come
+	}
+
+	if(tx_busy || pending == 0U)
+	{
+		return;
+	}
+
+	while(len < pending && len < CONSOLE_DMA_CHUNK_SIZE)
+	{
+		tx_chunk[len] = tx_ring[(uint16_t)(tx_tail + len) & (CONSOLE_TX_BUFFER_SIZE - 1U)];
+		len++;
+	}
+	tx_tail += len;
+
+	tx_busy = 1;
+	if(HAL_UART_Transmit_DMA(&huart2, tx_chunk, len) != HAL_OK)
+	{
+		tx_busy = 0;
+	}
+}
+#elif CONSOLE_BACKEND == CONSOLE_BACKEND_FIFO
+// The threshold interrupt pulls from the ring with console_tx_pop()
+static void console_start_tx(void)
+{
+	uart_fifo_tx_kick();
+}
+#endif
+
+#if CONSOLE_BACKEND != CONSOLE_BACKEND_POLLING
+// Must be called with interrupts masked, count must fit
+static void console_copy(const uint8_t *data, uint16_t count)
+{
+	for(uint16_t i = 0; i < count; i++)
+	{
+		tx_ring[(uint16_t)(tx_head + i) & (CONSOLE_TX_BUFFER_SIZE - 1U)] = data[i];
+	}
+	tx_head += count;
+	ConsoleStats.bytes_written += count;
+
+	console_start_tx();
+}
+
+// 1 while bytes of a frame are still in the ring. Must be called with
+// interrupts masked.
+static uint8_t console_frame_pending(void)
+{
+	uint16_t ahead = (uint16_t)(tx_frame_end - tx_tail);
+
+	if(ahead == 0U || ahead > (uint16_t)(tx_head - tx_tail))
+	{
+		tx_frame_end = tx_tail; // Sent, keep it close so the index cannot alias
+		return 0;
+	}
+	return 1;
+}
+
+// Copies as much of data as the policy allows, returns the number of bytes consumed
+static uint16_t console_enqueue(const uint8_t *data, uint16_t len)
+{
+	uint16_t space = CONSOLE_TX_BUFFER_SIZE - (uint16_t)(tx_head - tx_tail);
+	uint16_t count = len;
+
+	if(count > space)
+	{
+#if CONSOLE_FULL_POLICY == CONSOLE_FULL_OVERWRITE
+		if(console_frame_pending())
+		{
+			ConsoleStats.bytes_dropped += count - space;
+			count = space; // Forgetting old bytes would cut a frame, drop the excess instead
+		}
+		else if(count > CONSOLE_TX_BUFFER_SIZE)
+		{
+			// Only the newest part of an oversized write can survive
+			ConsoleStats.bytes_dropped += count - CONSOLE_TX_BUFFER_SIZE;
+			data += count - CONSOLE_TX_BUFFER_SIZE;
+			count = CONSOLE_TX_BUFFER_SIZE;
+		}
+		if(count > space)
+		{
+			ConsoleStats.bytes_dropped += count - space;
+			tx_tail += count - space; // Forget the oldest pending bytes
+		}
+#else
+		count = space;
+#endif
+	}
+
+	console_copy(data, count);
+
+#if CONSOLE_FULL_POLICY == CONSOLE_FULL_OVERWRITE
+	return len;
+#else
+	return count;
+#endif
+}
+
+// The whole frame or nothing, returns 1 when it was queued. Must be called
+// with interrupts masked.
+static uint8_t console_enqueue_frame(const uint8_t *data, uint16_t len)
+{
+	if(len > CONSOLE_TX_BUFFER_SIZE - (uint16_t)(tx_head - tx_tail))
+	{
+		return 0;
+	}
+	console_copy(data, len);
+	tx_frame_end = tx_head;
+	return 1;
+}
+#endif /* CONSOLE_BACKEND != CONSOLE_BACKEND_POLLING */
+
+#ifndef CONSOLE_DRAIN_MS
+#define CONSOLE_DRAIN_MS 200U // A full ring at 115200 baud takes about 90 ms
+#endif
+
+// Longest wait with the scheduler suspended: the 8-byte TX FIFO and the
+// shift register, 10 bits each, about 0.8 ms at 115200 baud
+#define CONSOLE_FIFO_DRAIN_US ((9U * 10U * 1000000U) / huart2.Init.BaudRate + 1U)
+
+// A clock switch changes the baud rate under the bytes on the wire. On
+// CLOCK_PREPARE the ring is let drain while the scheduler still runs, for up
+// to CONSOLE_DRAIN_MS, one tick at a time. On CLOCK_BEFORE, with the
+// scheduler suspended, only the FIFO still in flight is waited for, up to
+// the last stop bit and never longer than CONSOLE_FIFO_DRAIN_US; before the
+// scheduler starts interrupts are masked, so that is all there is. TIM2
+// times the waits, HAL_GetTick() does not advance then. After the switch BRR
+// is computed again from the new PCLK. Bytes queued after the drain, and
+// bytes received during the switch, may be garbled.
+static void console_clock_changed(clock_event event)
+{
+	if(event == CLOCK_PREPARE)
+	{
+		uint32_t start = timestamp_now();
+
+		while(xTaskGetSchedulerState() == taskSCHEDULER_RUNNING && console_pending() != 0U
+				&& (timestamp_now() - start) < CONSOLE_DRAIN_MS * 1000U)
+		{
+			vTaskDelay(1);
+		}
+		return;
+	}
+	if(event == CLOCK_BEFORE)
+	{
+		uint32_t start = timestamp_now();
+		uint32_t limit = CONSOLE_FIFO_DRAIN_US;
+
+		while((USART2->ISR & USART_ISR_TC) == 0U && (timestamp_now() - start) < limit)
+		{
+		}
+		return;
+	}
+
+	USART2->CR1 &= ~USART_CR1_UE;
+	USART2->BRR = UART_DIV_SAMPLING16(HAL_RCC_GetPCLK1Freq(), huart2.Init.BaudRate, huart2.Init.ClockPrescaler);
+	USART2->CR1 |= USART_CR1_UE;
+}
+
+void console_init(void)
+{
+#if (CONSOLE_BACKEND != CONSOLE_BACKEND_POLLING) && (CONSOLE_FULL_POLICY == CONSOLE_FULL_BLOCK)
+	xConsoleSpace = xSemaphoreCreateBinary();
+#endif
+	clock_register(console_clock_changed);
+}
+
+int console_write(const uint8_t *data, uint16_t len)
+{
+#if CONSOLE_BACKEND != CONSOLE_BACKEND_POLLING
+	uint16_t done = 0;
+
+	while(done < len)
+	{
+		if(in_isr())
+		{
+			UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+			done += console_enqueue(&data[done], len - done);
+			taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+		}
+		else
+		{
+			taskENTER_CRITICAL();
+			done += console_enqueue(&data[done], len - done);
+			taskEXIT_CRITICAL();
+		}
+
+#if CONSOLE_FULL_POLICY == CONSOLE_FULL_BLOCK
+		if(done < len && !in_isr() && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		{
+			// Woken when the hardware takes bytes, the timeout covers a missed give
+			xSemaphoreTake(xConsoleSpace, pdMS_TO_TICKS(10));
+			continue;
+		}
+#endif
+		if(done < len)
+		{
+			ConsoleStats.bytes_dropped += len - done;
+			break;
+		}
+	}
+
+	return done;
+#else
+	for(uint16_t i = 0; i < len; i++)
+	{
+		__io_putchar(data[i]);
+	}
+	ConsoleStats.bytes_written += len;
+
+	return len;
+#endif
+}
+
+// For binary frames: queues all len bytes or none, so a decoder never loses
+// sync on a truncated frame. Under CONSOLE_FULL_BLOCK a task waits for the
+// room; otherwise, and from an ISR, a frame that does not fit is dropped
+// whole. Returns len, or -1 when the frame was dropped.
+int console_write_frame(const uint8_t *data, uint16_t len)
+{
+#if CONSOLE_BACKEND != CONSOLE_BACKEND_POLLING
+	uint8_t queued = 0;
+
+	while(len <= CONSOLE_TX_BUFFER_SIZE)
+	{
+		if(in_isr())
+		{
+			UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+			queued = console_enqueue_frame(data, len);
+			taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+		}
+		else
+		{
+			taskENTER_CRITICAL();
+			queued = console_enqueue_frame(data, len);
+			taskEXIT_CRITICAL();
+		}
+
+#if CONSOLE_FULL_POLICY == CONSOLE_FULL_BLOCK
+		if(!queued && !in_isr() && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		{
+			xSemaphoreTake(xConsoleSpace, pdMS_TO_TICKS(10));
+			continue;
+		}
+#endif
+		break;
+	}
+
+	if(!queued)
+	{
+		ConsoleStats.frames_dropped++;
+		ConsoleStats.bytes_dropped += len;
+		return -1;
+	}
+	return len;
+#else
+	return console_write(data, len); // Blocking, every byte goes out
+#endif
+}
+
+uint16_t console_pending(void)
+{
+#if CONSOLE_BACKEND == CONSOLE_BACKEND_DMA
+	return (uint16_t)(tx_head - tx_tail) + (tx_busy ? 1U : 0U);
+#elif CONSOLE_BACKEND == CONSOLE_BACKEND_FIFO
+	return (uint16_t)(tx_head - tx_tail);
+#else
+	return 0;
+#endif
+}
+
+// Overrides the weak newlib stub in syscalls.c, every printf ends up here
+int _write(int file, char *ptr, int len)
+{
+	(void)file;
+	uint32_t start, elapsed;
+	int written;
+
+	if(in_isr() || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+	{
+		return console_write((const uint8_t *)ptr, (uint16_t)len);
+	}
+
+	start = console_cycles();
+	written = console_write((const uint8_t *)ptr, (uint16_t)len);
+	elapsed = console_cycles() - start;
+
+	ConsoleStats.write_calls++;
+	ConsoleStats.blocked_last = elapsed;
+	ConsoleStats.blocked_total += elapsed;
+	if(elapsed > ConsoleStats.blocked_max)
+	{
+		ConsoleStats.blocked_max = elapsed;
+	}
+
+	return written;
+}
+
+#if CONSOLE_BACKEND == CONSOLE_BACKEND_FIFO
+// Called from the USART2 interrupt, hands up to max pending bytes to the TX FIFO
+uint16_t console_tx_pop(uint8_t *dst, uint16_t max, BaseType_t *pxHigherPriorityTaskWoken)
+{
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint16_t pending = (uint16_t)(tx_head - tx_tail);
+	uint16_t len = 0;
+
+	while(len < pending && len < max)
+	{
+		dst[len] = tx_ring[(uint16_t)(tx_tail + len) & (CONSOLE_TX_BUFFER_SIZE - 1U)];
+		len++;
+	}
+	tx_tail += len;
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+
+#if CONSOLE_FULL_POLICY == CONSOLE_FULL_BLOCK
+	if(len > 0U)
+	{
+		xSemaphoreGiveFromISR(xConsoleSpace, pxHigherPriorityTaskWoken);
+	}
+#else
+	(void)pxHigherPriorityTaskWoken;
+#endif
+
+	return len;
+}
+#endif
+
+#if CONSOLE_BACKEND == CONSOLE_BACKEND_DMA
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if(huart->Instance != USART2)
+	{
+		return;
+	}
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	tx_busy = 0;
+	console_start_tx();
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+
+#if CONSOLE_FULL_POLICY == CONSOLE_FULL_BLOCK
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	xSemaphoreGiveFromISR(xConsoleSpace, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+#endif
+}
+#endif
@@ -0,0 +1,89 @@
+//Fixed-point brightness fades and the gamma mapping, see fade.h. No HAL or kernel calls.
+
+#include "fade.h"
+
+const char *const fade_curve_names[FADE_CURVE_COUNT] = { "linear", "ease", "sine" };
+
+// "ms" 0 jumps straight to "to"
+void fade_start(fade *f, uint16_t from, uint16_t to, uint16_t ms, fade_curve curve, fade_mode mode)
+{
+	f->from = (from > FADE_LEVEL_MAX) ? FADE_LEVEL_MAX : from;
+	f->to = (to > FADE_LEVEL_MAX) ? FADE_LEVEL_MAX : to;
+	f->position = (ms == 0U) ? FADE_ONE : 0U;
+	f->rate = (ms == 0U) ? FADE_ONE : (FADE_ONE + ms - 1U) / ms; // The one division, rounded up so the leg ends at "ms"
+	f->ms = (ms == 0U) ? 1U : ms;
+	f->curve = (curve < FADE_CURVE_COUNT) ? (uint8_t)curve : (uint8_t)FADE_LINEAR;
+	f->mode = (uint8_t)mode;
+	f->done = (ms == 0U && mode == FADE_ONCE);
+}
+
+// Position t (0..65536, Q16) along the curve, 0..65536
+static uint32_t fade_ease(uint8_t curve, uint32_t t)
+{
+	switch(curve)
+	{
+		case FADE_EASE_IN_OUT:
+		{
+			// t^2 (3 - 2t), t < 1 here. (3 - 2t) in Q14 keeps the product below 2^32.
+			uint32_t t2 = (t * t) >> 16;
+
+			return (t2 * ((3U * 65536U - 2U * t) >> 2)) >> 14;
+		}
+
+		case FADE_SINE:
+		{
+			uint32_t index = t >> 10; // 64 intervals
+			uint32_t frac = t & 0x3FFU;
+
+			if(index >= FADE_SINE_POINTS)
+			{
+				return 65536U;
+			}
+			return fade_sine[index] + ((((uint32_t)fade_sine[index + 1U] - fade_sine[index]) * frac) >> 10);
+		}
+
+		default:
+			return t;
+	}
+}
+
+// Advances the fade by elapsed_ms and returns its level
+uint16_t fade_step(fade *f, uint32_t elapsed_ms)
+{
+	if(f->done)
+	{
+		return f->to;
+	}
+
+	// A gap of a whole leg or more ends the leg. Below that the product is
+	// at most ms * rate <= FADE_ONE, no overflow.
+	uint32_t advance = (elapsed_ms < f->ms) ? elapsed_ms * f->rate : FADE_ONE;
+
+	f->position += advance;
+	if(f->position >= FADE_ONE)
+	{
+		if(f->mode != FADE_BOUNCE)
+		{
+			f->position = FADE_ONE;
+			f->done = 1;
+			return f->to;
+		}
+
+		// Turn around, keep the time past the end
+		uint16_t level = f->from;
+
+		f->from = f->to;
+		f->to = level;
+		f->position -= FADE_ONE;
+		if(f->position >= FADE_ONE)
+		{
+			f->position = 0;
+		}
+	}
+
+	uint32_t eased = fade_ease(f->curve, f->position >> 8);
+	int32_t span = (int32_t)f->to - (int32_t)f->from;
+
+	// span * eased fits: |span| < 1000, eased <= 65536
+	return (uint16_t)((int32_t)f->from + ((span * (int32_t)eased) >> 16));
+}
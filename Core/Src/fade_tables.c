@@ -0,0 +1,132 @@
+// Generated by Tools/fade_tables.py, do not edit
+
+#include "fade.h"
+
+// Level 0..999 to duty, 0..65535 of the period, CIE 1931 lightness
+const uint16_t fade_gamma[257] =
+{
+	    0,    28,    57,    85,   113,   142,   170,   198,   227,   255,   283,   312,
+	  340,   368,   397,   425,   453,   482,   510,   538,   567,   595,   625,   655,
+	  686,   718,   751,   785,   821,   857,   894,   933,   972,  1012,  1054,  1097,
+	 1141,  1186,  1232,  1279,  1328,  1378,  1429,  1481,  1535,  1590,  1646,  1703,
+	 1762,  1822,  1883,  1946,  2010,  2076,  2143,  2211,  2281,  2352,  2425,  2500,
+	 2575,  2653,  2731,  2812,  2894,  2977,  3062,  3149,  3237,  3327,  3419,  3512,
+	 3607,  3704,  3802,  3902,  4004,  4108,  4213,  4320,  4429,  4540,  4652,  4767,
+	 4883,  5001,  5121,  5243,  5367,  5493,  5621,  5751,  5882,  6016,  6152,  6289,
+	 6429,  6571,  6715,  6861,  7009,  7159,  7312,  7466,  7623,  7782,  7943,  8106,
+	 8272,  8439,  8609,  8781,  8956,  9133,  9312,  9493,  9677,  9863, 10052, 10243,
+	10436, 10632, 10830, 11030, 11234, 11439, 11647, 11858, 12071, 12286, 12504, 12725,
+	12948, 13174, 13403, 13634, 13868, 14104, 14343, 14585, 14830, 15077, 15327, 15579,
+	15835, 16093, 16354, 16618, 16885, 17154, 17426, 17702, 17980, 18261, 18545, 18831,
+	19121, 19414, 19710, 20008, 20310, 20615, 20922, 21233, 21547, 21864, 22184, 22507,
+	22833, 23163, 23495, 23831, 24170, 24512, 24857, 25206, 25558, 25913, 26271, 26632,
+	26997, 27366, 27737, 28112, 28490, 28872, 29257, 29645, 30037, 30432, 30831, 31233,
+	31639, 32048, 32461, 32877, 33297, 33720, 34147, 34578, 35012, 35450, 35891, 36336,
+	36785, 37237, 37693, 38153, 38616, 39083, 39554, 40029, 40507, 40990, 41476, 41966,
+	42460, 42957, 43459, 43964, 44473, 44987, 45504, 46025, 46550, 47079, 47612, 48149,
+	48690, 49235, 49785, 50338, 50895, 51457, 52022, 52592, 53166, 53744, 54326, 54912,
+	55503, 56097, 56696, 57300, 57907, 58519, 59135, 59755, 60380, 61009, 61642, 62280,
+	62922, 63569, 64220, 64875, 65535,
+};
+
+// (1 - cos(pi * t)) / 2, t = 0..1 in 64 steps, 1.0 = 65535
+const uint16_t fade_sine[65] =
+{
+	    0,    39,   158,   355,   630,   982,  1411,  1915,  2494,  3146,  3869,  4662,
+	 5522,  6448,  7438,  8489,  9598, 10762, 11980, 13248, 14563, 15922, 17321, 18758,
+	20228, 21729, 23256, 24806, 26375, 27960, 29556, 31160, 32768, 34376, 35980, 37576,
+	39161, 40730, 42280, 43807, 45308, 46778, 48215, 49614, 50973, 52288, 53556, 54774,
+	55938, 57047, 58098, 59088, 60014, 60874, 61667, 62390, 63042, 63621, 64125, 64554,
+	64906, 65181, 65378, 65497, 65535,
+};
+
+// One breath for a period of 16000 counts, streamed into TIM1 CCR4
+const uint16_t fade_breath[1024] =
+{
+	    0,     0,     0,     0,     0,     0,     0,     0,     1,     1,     1,     1,
+	    1,     3,     3,     3,     3,     5,     5,     5,     6,     6,     8,     8,
+	    8,    10,    10,    12,    12,    14,    14,    15,    17,    17,    19,    19,
+	   21,    22,    24,    24,    26,    28,    28,    30,    31,    33,    35,    37,
+	   38,    38,    40,    42,    44,    45,    47,    49,    51,    52,    54,    56,
+	   58,    62,    63,    65,    67,    68,    70,    74,    76,    77,    79,    83,
+	   84,    86,    90,    92,    93,    97,    99,   102,   104,   106,   109,   111,
+	  115,   116,   120,   122,   125,   129,   130,   134,   136,   139,   143,   145,
+	  148,   152,   156,   158,   162,   166,   170,   172,   176,   180,   184,   188,
+	  192,   197,   201,   204,   208,   213,   218,   222,   227,   232,   237,   242,
+	  247,   252,   260,   266,   271,   277,   282,   288,   293,   299,   308,   314,
+	  320,   326,   336,   342,   349,   355,   365,   372,   379,   389,   396,   403,
+	  414,   421,   428,   440,   447,   459,   467,   474,   486,   495,   507,   515,
+	  528,   536,   550,   558,   572,   585,   594,   609,   618,   632,   642,   657,
+	  671,   682,   697,   712,   723,   739,   755,   766,   782,   799,   810,   827,
+	  845,   862,   874,   892,   911,   929,   942,   960,   979,   999,  1019,  1039,
+	 1052,  1072,  1093,  1114,  1135,  1157,  1171,  1193,  1215,  1238,  1260,  1283,
+	 1306,  1330,  1354,  1378,  1402,  1419,  1444,  1469,  1494,  1520,  1546,  1572,
+	 1599,  1626,  1653,  1680,  1708,  1737,  1765,  1794,  1822,  1852,  1882,  1912,
+	 1942,  1973,  2004,  2035,  2066,  2098,  2131,  2163,  2196,  2229,  2263,  2297,
+	 2343,  2377,  2412,  2448,  2484,  2520,  2556,  2593,  2630,  2667,  2705,  2743,
+	 2782,  2821,  2860,  2900,  2940,  2993,  3034,  3075,  3117,  3159,  3201,  3244,
+	 3287,  3331,  3375,  3419,  3463,  3508,  3554,  3599,  3646,  3708,  3755,  3802,
+	 3850,  3899,  3947,  3996,  4046,  4096,  4146,  4197,  4248,  4299,  4351,  4404,
+	 4457,  4510,  4563,  4617,  4672,  4727,  4782,  4838,  4894,  4951,  5008,  5065,
+	 5123,  5181,  5240,  5300,  5339,  5400,  5460,  5521,  5582,  5644,  5706,  5769,
+	 5832,  5896,  5960,  6003,  6068,  6133,  6199,  6265,  6332,  6377,  6444,  6512,
+	 6581,  6650,  6719,  6766,  6836,  6907,  6978,  7026,  7098,  7170,  7243,  7292,
+	 7366,  7440,  7490,  7565,  7641,  7692,  7768,  7845,  7897,  7975,  8053,  8106,
+	 8185,  8238,  8318,  8372,  8453,  8534,  8589,  8671,  8727,  8810,  8865,  8950,
+	 9006,  9091,  9148,  9205,  9291,  9349,  9436,  9494,  9553,  9641,  9700,  9760,
+	 9850,  9910,  9970, 10062, 10122, 10183, 10245, 10337, 10399, 10461, 10524, 10618,
+	10682, 10745, 10809, 10872, 10937, 11001, 11066, 11163, 11229, 11294, 11360, 11426,
+	11492, 11559, 11625, 11693, 11760, 11828, 11861, 11929, 11998, 12066, 12135, 12204,
+	12274, 12343, 12378, 12448, 12518, 12589, 12624, 12695, 12766, 12837, 12873, 12945,
+	13017, 13053, 13125, 13162, 13235, 13308, 13345, 13418, 13455, 13529, 13566, 13640,
+	13677, 13715, 13790, 13827, 13903, 13940, 13978, 14054, 14092, 14130, 14206, 14245,
+	14283, 14322, 14398, 14437, 14476, 14515, 14554, 14592, 14671, 14710, 14749, 14788,
+	14828, 14867, 14906, 14946, 14985, 15025, 15065, 15105, 15105, 15145, 15184, 15225,
+	15265, 15305, 15345, 15345, 15385, 15426, 15426, 15467, 15507, 15548, 15548, 15588,
+	15588, 15629, 15670, 15670, 15711, 15711, 15752, 15752, 15792, 15792, 15792, 15834,
+	15834, 15875, 15875, 15875, 15916, 15916, 15916, 15916, 15958, 15958, 15958, 15958,
+	15958, 16000, 16000, 16000, 16000, 16000, 16000, 16000, 16000, 16000, 16000, 16000,
+	16000, 16000, 16000, 16000, 15958, 15958, 15958, 15958, 15958, 15916, 15916, 15916,
+	15916, 15875, 15875, 15875, 15834, 15834, 15792, 15792, 15792, 15752, 15752, 15711,
+	15711, 15670, 15670, 15629, 15588, 15588, 15548, 15548, 15507, 15467, 15426, 15426,
+	15385, 15345, 15345, 15305, 15265, 15225, 15184, 15145, 15105, 15105, 15065, 15025,
+	14985, 14946, 14906, 14867, 14828, 14788, 14749, 14710, 14671, 14592, 14554, 14515,
+	14476, 14437, 14398, 14322, 14283, 14245, 14206, 14130, 14092, 14054, 13978, 13940,
+	13903, 13827, 13790, 13715, 13677, 13640, 13566, 13529, 13455, 13418, 13345, 13308,
+	13235, 13162, 13125, 13053, 13017, 12945, 12873, 12837, 12766, 12695, 12624, 12589,
+	12518, 12448, 12378, 12343, 12274, 12204, 12135, 12066, 11998, 11929, 11861, 11828,
+	11760, 11693, 11625, 11559, 11492, 11426, 11360, 11294, 11229, 11163, 11066, 11001,
+	10937, 10872, 10809, 10745, 10682, 10618, 10524, 10461, 10399, 10337, 10245, 10183,
+	10122, 10062,  9970,  9910,  9850,  9760,  9700,  9641,  9553,  9494,  9436,  9349,
+	 9291,  9205,  9148,  9091,  9006,  8950,  8865,  8810,  8727,  8671,  8589,  8534,
+	 8453,  8372,  8318,  8238,  8185,  8106,  8053,  7975,  7897,  7845,  7768,  7692,
+	 7641,  7565,  7490,  7440,  7366,  7292,  7243,  7170,  7098,  7026,  6978,  6907,
+	 6836,  6766,  6719,  6650,  6581,  6512,  6444,  6377,  6332,  6265,  6199,  6133,
+	 6068,  6003,  5960,  5896,  5832,  5769,  5706,  5644,  5582,  5521,  5460,  5400,
+	 5339,  5300,  5240,  5181,  5123,  5065,  5008,  4951,  4894,  4838,  4782,  4727,
+	 4672,  4617,  4563,  4510,  4457,  4404,  4351,  4299,  4248,  4197,  4146,  4096,
+	 4046,  3996,  3947,  3899,  3850,  3802,  3755,  3708,  3646,  3599,  3554,  3508,
+	 3463,  3419,  3375,  3331,  3287,  3244,  3201,  3159,  3117,  3075,  3034,  2993,
+	 2953,  2900,  2860,  2821,  2782,  2743,  2705,  2667,  2630,  2593,  2556,  2520,
+	 2484,  2448,  2412,  2377,  2343,  2297,  2263,  2229,  2196,  2163,  2131,  2098,
+	 2066,  2035,  2004,  1973,  1942,  1912,  1882,  1852,  1822,  1794,  1765,  1737,
+	 1708,  1680,  1653,  1626,  1599,  1572,  1546,  1520,  1494,  1469,  1444,  1419,
+	 1402,  1378,  1354,  1330,  1306,  1283,  1260,  1238,  1215,  1193,  1171,  1157,
+	 1135,  1114,  1093,  1072,  1052,  1039,  1019,   999,   979,   960,   942,   929,
+	  911,   892,   874,   862,   845,   827,   810,   799,   782,   766,   755,   739,
+	  723,   712,   697,   682,   671,   657,   642,   632,   618,   609,   594,   585,
+	  572,   558,   550,   536,   528,   515,   507,   495,   486,   474,   467,   459,
+	  447,   440,   428,   421,   414,   403,   396,   389,   379,   372,   365,   355,
+	  349,   342,   336,   326,   320,   314,   308,   299,   293,   288,   282,   277,
+	  271,   266,   260,   252,   247,   242,   237,   232,   227,   222,   218,   213,
+	  208,   204,   201,   197,   192,   188,   184,   180,   176,   172,   170,   166,
+	  162,   158,   156,   152,   148,   145,   143,   139,   136,   134,   130,   129,
+	  125,   122,   120,   116,   115,   111,   109,   106,   104,   102,    99,    97,
+	   93,    92,    90,    86,    84,    83,    79,    77,    76,    74,    70,    68,
+	   67,    65,    63,    62,    58,    56,    54,    52,    51,    49,    47,    45,
+	   44,    42,    40,    38,    38,    37,    35,    33,    31,    30,    28,    28,
+	   26,    24,    24,    22,    21,    19,    19,    17,    17,    15,    14,    14,
+	   12,    12,    10,    10,     8,     8,     8,     6,     6,     5,     5,     5,
+	    3,     3,     3,     3,     1,     1,     1,     1,     1,     0,     0,     0,
+	    0,     0,     0,     0,
+};
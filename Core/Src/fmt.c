@@ -0,0 +1,307 @@
+// Reentrant printf replacement, see fmt.h. Output is assembled in a small
+// stack buffer and handed to the console through _write() in console.c.
+
+#include <stdio.h>
+
+#include "fmt.h"
+
+#define FMT_LEFT 0x01U // '-' flag
+#define FMT_ZERO 0x02U // '0' flag
+
+typedef struct
+{
+	char *buf;
+	size_t size;    // Capacity of buf
+	size_t pos;     // Characters currently in buf
+	int total;      // Characters produced, the printf return value
+	uint8_t flush;  // 1 = write full buffers to the console, 0 = truncate (snprintf)
+} fmt_out;
+
+int _write(int file, char *ptr, int len);
+
+static void fmt_put(fmt_out *out, char c)
+{
+	if(out->pos == out->size && out->flush)
+	{
+		_write(1, out->buf, (int)out->pos);
+		out->pos = 0;
+	}
+	if(out->pos < out->size)
+	{
+		out->buf[out->pos++] = c;
+	}
+	out->total++;
+}
+
+static void fmt_pad(fmt_out *out, char c, int count)
+{
+	while(count-- > 0)
+	{
+		fmt_put(out, c);
+	}
+}
+
+static void fmt_number(fmt_out *out, uint32_t value, char conv, uint8_t negative, int width, uint8_t flags)
+{
+	const char *set = (conv == 'X') ? "0123456789ABCDEF" : "0123456789abcdef";
+	char digits[10];
+	int n = 0;
+
+	if(conv == 'x' || conv == 'X')
+	{
+		do
+		{
+			digits[n++] = set[value & 0xFU];
+			value >>= 4;
+		} while(value != 0U);
+	}
+	else
+	{
+		do
+		{
+			digits[n++] = set[value % 10U];
+			value /= 10U;
+		} while(value != 0U);
+	}
+
+	width -= n + negative;
+	if(!(flags & (FMT_LEFT | FMT_ZERO)))
+	{
+		fmt_pad(out, ' ', width);
+	}
+	if(negative)
+	{
+		fmt_put(out, '-');
+	}
+	if((flags & FMT_ZERO) && !(flags & FMT_LEFT))
+	{
+		fmt_pad(out, '0', width);
+	}
+	while(n > 0)
+	{
+		fmt_put(out, digits[--n]);
+	}
+	if(flags & FMT_LEFT)
+	{
+		fmt_pad(out, ' ', width);
+	}
+}
+
+static void fmt_string(fmt_out *out, const char *s, int width, uint8_t flags)
+{
+	int len = 0;
+
+	if(s == NULL)
+	{
+		s = "(null)";
+	}
+	while(s[len] != '\0')
+	{
+		len++;
+	}
+
+	if(!(flags & FMT_LEFT))
+	{
+		fmt_pad(out, ' ', width - len);
+	}
+	while(*s != '\0')
+	{
+		fmt_put(out, *s++);
+	}
+	if(flags & FMT_LEFT)
+	{
+		fmt_pad(out, ' ', width - len);
+	}
+}
+
+static void fmt_format(fmt_out *out, const char *format, va_list ap)
+{
+	while(*format != '\0')
+	{
+		uint8_t flags = 0;
+		int width = 0;
+
+		if(*format != '%')
+		{
+			fmt_put(out, *format++);
+			continue;
+		}
+		format++;
+
+		for(;; format++)
+		{
+			if(*format == '-')
+			{
+				flags |= FMT_LEFT;
+			}
+			else if(*format == '0')
+			{
+				flags |= FMT_ZERO;
+			}
+			else
+			{
+				break;
+			}
+		}
+		while(*format >= '0' && *format <= '9')
+		{
+			width = width * 10 + (*format++ - '0');
+		}
+		const char *modifier = format;
+		uint8_t longs = 0;
+
+		while(*format == 'l' || *format == 'h' || *format == 'z' || *format == 'j')
+		{
+			longs += (*format == 'l') ? 1U : ((*format == 'j') ? 2U : 0U);
+			format++; // int, long and size_t are all 32 bits
+		}
+
+		if(longs >= 2U && *format != '\0')
+		{
+			// 64-bit argument (ll, j): take it off the list so the following
+			// arguments stay in place, and print the conversion verbatim
+			if(*format != 's' && *format != 'c' && *format != '%')
+			{
+				(void)va_arg(ap, uint64_t);
+			}
+			fmt_put(out, '%');
+			while(modifier <= format)
+			{
+				fmt_put(out, *modifier++);
+			}
+			format++;
+			continue;
+		}
+
+		switch(*format)
+		{
+		case 'u':
+		case 'x':
+		case 'X':
+			fmt_number(out, va_arg(ap, uint32_t), *format, 0, width, flags);
+			break;
+		case 'd':
+		case 'i':
+		{
+			int32_t value = va_arg(ap, int32_t);
+			fmt_number(out, (value < 0) ? (0U - (uint32_t)value) : (uint32_t)value, 'u', (value < 0), width, flags);
+			break;
+		}
+		case 's':
+			fmt_string(out, va_arg(ap, const char *), width, flags);
+			break;
+		case 'c':
+			fmt_put(out, (char)va_arg(ap, int));
+			break;
+		case '%':
+			fmt_put(out, '%');
+			break;
+		case '\0':
+			return;
+		default:
+			// Unsupported conversion, print it verbatim so the mistake is visible
+			fmt_put(out, '%');
+			fmt_put(out, *format);
+			break;
+		}
+		format++;
+	}
+}
+
+int fmt_vprintf(const char *format, va_list ap)
+{
+	char chunk[FMT_CHUNK_SIZE];
+	fmt_out out = { chunk, sizeof(chunk), 0, 0, 1 };
+
+	fmt_format(&out, format, ap);
+	if(out.pos > 0U)
+	{
+		_write(1, chunk, (int)out.pos);
+	}
+	return out.total;
+}
+
+int fmt_printf(const char *format, ...)
+{
+	va_list ap;
+	int count;
+
+	va_start(ap, format);
+	count = fmt_vprintf(format, ap);
+	va_end(ap);
+	return count;
+}
+
+int fmt_vsnprintf(char *buf, size_t size, const char *format, va_list ap)
+{
+	fmt_out out = { buf, (size > 0U) ? size - 1U : 0U, 0, 0, 0 };
+
+	fmt_format(&out, format, ap);
+	if(size > 0U)
+	{
+		buf[out.pos] = '\0';
+	}
+	return out.total;
+}
+
+int fmt_snprintf(char *buf, size_t size, const char *format, ...)
+{
+	va_list ap;
+	int count;
+
+	va_start(ap, format);
+	count = fmt_vsnprintf(buf, size, format, ap);
+	va_end(ap);
+	return count;
+}
+
+#if FMT_REPLACE_PRINTF
+// Strong definitions win over libc, so newlib's vfprintf and stdout FILE are
+// never linked. GCC turns some printf calls into puts or putchar, cover those too.
+#undef putchar
+
+int printf(const char *format, ...)
+{
+	va_list ap;
+	int count;
+
+	va_start(ap, format);
+	count = fmt_vprintf(format, ap);
+	va_end(ap);
+	return count;
+}
+
+int vprintf(const char *format, va_list ap)
+{
+	return fmt_vprintf(format, ap);
+}
+
+int puts(const char *s)
+{
+	return fmt_printf("%s\n", s);
+}
+
+int putchar(int c)
+{
+	char ch = (char)c;
+
+	_write(1, &ch, 1);
+	return (unsigned char)c;
+}
+
+int snprintf(char *buf, size_t size, const char *format, ...)
+{
+	va_list ap;
+	int count;
+
+	va_start(ap, format);
+	count = fmt_vsnprintf(buf, size, format, ap);
+	va_end(ap);
+	return count;
+}
+
+int vsnprintf(char *buf, size_t size, const char *format, va_list ap)
+{
+	return fmt_vsnprintf(buf, size, format, ap);
+}
+#endif /* FMT_REPLACE_PRINTF */
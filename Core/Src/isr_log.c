@@ -0,0 +1,32 @@
+#include "isr_log.h"
+
+isr_log_channel isr_log_channels[ISR_LOG_CH_COUNT];
+
+static void isr_log_drain(isr_log_channel *ch)
+{
+	while(ch->tail != ch->head)
+	{
+		uint8_t tail = ch->tail;
+		isr_log_record rec = ch->records[tail];
+
+		__DMB(); // Finish reading the record before handing the slot back
+		ch->tail = (uint8_t)((tail + 1U) & (ISR_LOG_DEPTH - 1U));
+
+		log_write_at(rec.timestamp, (const char *)(uintptr_t)rec.id, &rec.arg, rec.nargs);
+	}
+}
+
+void vLogDrainTask(void *pvParameters)
+{
+	TickType_t xLastWakeTime = xTaskGetTickCount();
+	const TickType_t xFrequency = pdMS_TO_TICKS(ISR_LOG_DRAIN_PERIOD_MS);
+
+	while(1)
+	{
+		for(uint32_t i = 0; i < ISR_LOG_CH_COUNT; i++)
+		{
+			isr_log_drain(&isr_log_channels[i]);
+		}
+		vTaskDelayUntil(&xLastWakeTime, xFrequency);
+	}
+}
@@ -0,0 +1,124 @@
+//Log2 latency histograms of the button-to-LED path, see latency.h
+
+#include <string.h>
+
+#include "latency.h"
+#include "cmsis_os.h"
+
+latency_hist latency_hists[LATENCY_STAGE_COUNT];
+latency_ring latency_rings[LATENCY_STAGE_COUNT];
+
+const uint8_t latency_log2[16] = { 0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+
+const char *const latency_stage_names[LATENCY_STAGE_COUNT] =
+{
+	"debounce", "receive", "first-edge", "pattern"
+};
+
+// Empties every stage, samples still in the rings included. Called at init,
+// the min has to start high.
+void latency_reset(void)
+{
+	for(uint32_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+	{
+		UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+		memset(&latency_hists[stage], 0, sizeof(latency_hists[stage]));
+		latency_hists[stage].min_us = UINT32_MAX;
+		latency_rings[stage].tail = latency_rings[stage].head;
+		taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+	}
+}
+
+// Bins the samples waiting in every ring. Task context; any task may call
+// it, the critical section around each sample keeps the consumers and the
+// producers apart.
+void latency_drain(void)
+{
+	for(uint32_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+	{
+		latency_ring *r = &latency_rings[stage];
+		uint8_t more = 1;
+
+		while(more)
+		{
+			UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+			uint32_t pending = r->head - r->tail;
+
+			if(pending > LATENCY_RING_SIZE)
+			{
+				latency_hists[stage].dropped += pending - LATENCY_RING_SIZE;
+				r->tail = r->head - LATENCY_RING_SIZE;
+			}
+			more = (pending != 0U);
+			if(more)
+			{
+				latency_record(&latency_hists[stage], r->samples[r->tail & (LATENCY_RING_SIZE - 1U)]);
+				r->tail++;
+			}
+			taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+		}
+	}
+}
+
+// Value of the sample at "rank" (1..count), placed inside its bin by its
+// rank among the bin's n samples
+static uint32_t latency_rank(const latency_hist *h, uint32_t rank)
+{
+	uint32_t below = 0;
+
+	for(uint32_t bin = 1; bin < LATENCY_BINS; bin++)
+	{
+		uint32_t n = h->bins[bin];
+
+		below += h->bins[bin - 1U];
+		if(rank <= below)
+		{
+			break; // In bin 0 or already placed
+		}
+		if(rank <= below + n)
+		{
+			uint32_t low = 1UL << (bin - 1U); // Bin holds low .. 2 low - 1
+			uint64_t offset = (uint64_t)(low - 1U) * (2U * (rank - below) - 1U) / (2U * n);
+
+			return low + (uint32_t)offset;
+		}
+	}
+	return 0;
+}
+
+// Summary of one histogram, from a copy taken with interrupts masked after
+// the rings are drained. Returns the sample count, the other fields are 0
+// when it is 0.
+uint32_t latency_summarize(const latency_hist *h, latency_summary *summary)
+{
+	latency_hist copy;
+
+	latency_drain();
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+	copy = *h;
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+
+	memset(summary, 0, sizeof(*summary));
+	for(uint32_t bin = 0; bin < LATENCY_BINS; bin++)
+	{
+		summary->count += copy.bins[bin];
+	}
+	if(summary->count == 0U)
+	{
+		return 0;
+	}
+
+	summary->dropped = copy.dropped;
+	summary->min_us = copy.min_us;
+	summary->max_us = copy.max_us;
+	summary->p50_us = latency_rank(&copy, (uint32_t)(((uint64_t)summary->count * 50U + 99U) / 100U));
+	summary->p99_us = latency_rank(&copy, (uint32_t)(((uint64_t)summary->count * 99U + 99U) / 100U));
+
+	// Interpolation can leave the range actually seen
+	summary->p50_us = (summary->p50_us < copy.min_us) ? copy.min_us : (summary->p50_us > copy.max_us) ? copy.max_us : summary->p50_us;
+	summary->p99_us = (summary->p99_us < copy.min_us) ? copy.min_us : (summary->p99_us > copy.max_us) ? copy.max_us : summary->p99_us;
+	return summary->count;
+}
@@ -1,5 +1,14 @@
 #include "led.h"
 
+const char *const led_names[LED_COUNT] = { "green", "blue", "red" };
+
+const uint16_t led_masks[LED_COUNT] =
+{
+	[LED_GREEN] = LED_MASK_GREEN,
+	[LED_BLUE]  = LED_MASK_BLUE,
+	[LED_RED]   = LED_MASK_RED,
+};
+
 void led_gpio_init(void)
 {
 	// Enable GPIOC clock
@@ -14,15 +23,3 @@ void led_gpio_init(void)
 	GPIOC->OSPEEDR |= (3U << (2*12)); // PC12 high speed
 }
 
-void led_on(uint16_t led_pin)
-{
-	GPIOC->ODR |= (1U << led_pin); // Set the pin high to turn on the LED
-}
-
-void led_off(uint16_t led_pin)
-{
-	GPIOC->ODR &= ~(1U << led_pin); // Set the pin low to turn off the LED
-}
-
-
-
@@ -0,0 +1,203 @@
+//LED ownership by priority layer, see led_arb.h
+
+#include "led_arb.h"
+#include "pwm.h"
+#include "bam.h"
+
+static uint16_t claimed[LED_LAYER_COUNT] = { [LED_LAYER_BACKGROUND] = LED_MASK_ALL };
+static uint16_t visible[LED_LAYER_COUNT] = { [LED_LAYER_BACKGROUND] = LED_MASK_ALL }; // LEDs the layer is on top of
+static uint16_t pins[LED_LAYER_COUNT];  // Pin states each layer last wrote
+static uint16_t level[LED_LAYER_COUNT]; // Blue PWM level each layer last wrote
+static uint16_t dimmed[LED_LAYER_COUNT]; // GPIO LEDs the layer shows at a BAM level
+static uint16_t bright[LED_LAYER_COUNT][LED_COUNT]; // Their levels
+
+LedArbProfiler LedArbStats;
+
+// Critical section. Recomputes which layer is on top of each LED and shows
+// that layer's state on the LEDs in "changed".
+static void led_arb_update(uint16_t changed)
+{
+	uint16_t above = 0, set = 0, clear = 0, switched = 0;
+
+	for(int32_t layer = LED_LAYER_COUNT - 1; layer >= 0; layer--)
+	{
+		visible[layer] = claimed[layer] & ~above;
+		above |= claimed[layer];
+
+		uint16_t show = visible[layer] & changed;
+		uint16_t dim = show & dimmed[layer];
+
+		for(uint32_t led = 0; led < LED_COUNT; led++)
+		{
+			if(dim & led_masks[led])
+			{
+				bam_set(led_masks[led], bright[layer][led]);
+			}
+		}
+		show &= ~dim;
+		switched |= show;
+		set |= pins[layer] & show;
+		clear |= ~pins[layer] & show;
+		if(show & LED_MASK_BLUE)
+		{
+			set_pwm_brightness(level[layer]);
+		}
+	}
+
+	// PC11 is in alternate function mode, its output register is not used
+	bam_release(switched & ~LED_MASK_BLUE);
+	led_frame(set & ~LED_MASK_BLUE, clear & ~LED_MASK_BLUE);
+}
+
+// The LEDs in mask show the layer's state from now on, a new claim starts
+// with them off. Claiming for the background layer changes nothing.
+void led_arb_claim(led_layer layer, uint16_t mask)
+{
+	if(layer >= LED_LAYER_COUNT || layer == LED_LAYER_BACKGROUND)
+	{
+		return;
+	}
+	mask &= LED_MASK_ALL;
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint16_t fresh = mask & ~claimed[layer];
+
+	pins[layer] &= ~fresh;
+	dimmed[layer] &= ~fresh;
+	if(fresh & LED_MASK_BLUE)
+	{
+		level[layer] = 0;
+	}
+	claimed[layer] |= mask;
+	led_arb_update(mask);
+	LedArbStats.claims++;
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// The LEDs in mask show the next lower claimed layer, at least the background
+void led_arb_release(led_layer layer, uint16_t mask)
+{
+	if(layer >= LED_LAYER_COUNT || layer == LED_LAYER_BACKGROUND)
+	{
+		return;
+	}
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	mask &= claimed[layer];
+	claimed[layer] &= ~mask;
+	led_arb_update(mask);
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// Shows the owners' state again on the LEDs in mask, after something outside
+// the layers (the shell "rgb" command) drove them
+void led_arb_refresh(uint16_t mask)
+{
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	led_arb_update(mask & LED_MASK_ALL);
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// Like led_frame(), for the pins the layer owns. The others keep the state
+// for when the layers above release them. Pins the layer has not claimed are
+// ignored.
+void led_arb_frame(led_layer layer, uint16_t set_mask, uint16_t clear_mask)
+{
+	if(layer >= LED_LAYER_COUNT)
+	{
+		return;
+	}
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint16_t mask = claimed[layer];
+
+	pins[layer] = (pins[layer] & ~(clear_mask & mask)) | (set_mask & mask);
+	// Blue is shown through led_arb_pwm() and dimmed LEDs through BAM, as in led_arb_update()
+	set_mask &= visible[layer] & ~(LED_MASK_BLUE | dimmed[layer]);
+	clear_mask &= visible[layer] & ~(LED_MASK_BLUE | dimmed[layer]);
+	if((set_mask | clear_mask) != 0U)
+	{
+		led_frame(set_mask, clear_mask);
+	}
+	else
+	{
+		LedArbStats.shadowed++;
+	}
+	LedArbStats.writes++;
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// set_pwm_brightness() for the layer, 0..999
+void led_arb_pwm(led_layer layer, uint16_t new_level)
+{
+	if(layer >= LED_LAYER_COUNT)
+	{
+		return;
+	}
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	level[layer] = new_level;
+	if(visible[layer] & LED_MASK_BLUE)
+	{
+		set_pwm_brightness(new_level);
+	}
+	else
+	{
+		LedArbStats.shadowed++;
+	}
+	LedArbStats.writes++;
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// 0..999 for any LED of the layer, or LED_ARB_SWITCHED to show its pin state
+// again. Blue goes to led_arb_pwm() (LED_ARB_SWITCHED is off there), the GPIO
+// LEDs to BAM while the layer is on top of them.
+void led_arb_brightness(led_layer layer, led_id led, uint16_t new_level)
+{
+	if(layer >= LED_LAYER_COUNT || led >= LED_COUNT)
+	{
+		return;
+	}
+	if(led == LED_BLUE)
+	{
+		led_arb_pwm(layer, (new_level == LED_ARB_SWITCHED) ? 0U : new_level);
+		return;
+	}
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint16_t mask = led_masks[led] & claimed[layer];
+
+	if(new_level == LED_ARB_SWITCHED)
+	{
+		dimmed[layer] &= ~mask;
+	}
+	else
+	{
+		dimmed[layer] |= mask;
+		bright[layer][led] = new_level;
+	}
+	if(mask & visible[layer])
+	{
+		led_arb_update(mask);
+	}
+	else
+	{
+		LedArbStats.shadowed++;
+	}
+	LedArbStats.writes++;
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+led_layer led_arb_owner(led_id led)
+{
+	uint16_t mask = (led < LED_COUNT) ? led_masks[led] : 0U;
+
+	for(int32_t layer = LED_LAYER_COUNT - 1; layer > 0; layer--)
+	{
+		if(visible[layer] & mask)
+		{
+			return (led_layer)layer;
+		}
+	}
+	return LED_LAYER_BACKGROUND;
+}
@@ -0,0 +1,302 @@
+//Periodic LED channels from one software timer, see led_sched.h
+
+#include <string.h>
+
+#include "led_sched.h"
+#include "led.h"
+#include "led_arb.h"
+#include "timers.h"
+
+#if LED_SCHED_MAX_CHANNELS > 32U
+#error "LED_SCHED_MAX_CHANNELS is limited to 32, callbacks are tracked in one word"
+#endif
+
+typedef struct
+{
+	const led_sched_config *config; // NULL = free
+	TickType_t start;      // Start of the current period
+	TickType_t next;       // Next deadline: period start, or the off edge when "on"
+	uint32_t runs;         // Periods started
+	uint32_t overruns;     // Deadlines found a whole period or more late
+	uint32_t skipped;      // Period starts dropped by those, never caught up
+	uint16_t period;       // Ticks
+	uint16_t on_ticks;     // Ticks the pins stay on, 0 = never, period = always
+	uint8_t duty;
+	uint8_t on;
+} led_sched_channel;
+
+static led_sched_channel channels[LED_SCHED_MAX_CHANNELS];
+static uint8_t order[LED_SCHED_MAX_CHANNELS]; // Channel numbers, earliest deadline first
+static uint8_t channel_count;
+static TimerHandle_t xLedSchedTimer;
+
+static void led_sched_callback(TimerHandle_t xTimer);
+
+void led_sched_init(void)
+{
+	// One-shot, every callback re-arms it for the next deadline
+	xLedSchedTimer = xTimerCreate("LED Sched", 1, pdFALSE, NULL, led_sched_callback);
+}
+
+// Deadline reached, also right for deadlines across the tick counter wrap
+static int led_sched_due(TickType_t deadline, TickType_t now)
+{
+	return (int32_t)(now - deadline) >= 0;
+}
+
+// Moves order[pos] to its place after its deadline changed, the rest stays sorted
+static void led_sched_sift(uint8_t pos)
+{
+	uint8_t ch = order[pos];
+	TickType_t next = channels[ch].next;
+
+	while(pos + 1U < channel_count && (int32_t)(channels[order[pos + 1U]].next - next) < 0)
+	{
+		order[pos] = order[pos + 1U];
+		pos++;
+	}
+	while(pos > 0U && (int32_t)(next - channels[order[pos - 1U]].next) < 0)
+	{
+		order[pos] = order[pos - 1U];
+		pos--;
+	}
+	order[pos] = ch;
+}
+
+static void led_sched_set_ticks(led_sched_channel *c, uint32_t period_ms, uint8_t duty)
+{
+	c->period = (uint16_t)pdMS_TO_TICKS(period_ms);
+	if(c->period == 0U)
+	{
+		c->period = 1U;
+	}
+	c->duty = duty;
+	c->on_ticks = (c->config->mask != 0U) ? (uint16_t)(((uint32_t)c->period * duty) / 100U) : 0U;
+}
+
+// The channel starts a new period at "start", pins off until then
+static void led_sched_restart(uint8_t pos, TickType_t start)
+{
+	led_sched_channel *c = &channels[order[pos]];
+
+	c->next = start;
+	c->on = 0;
+	led_sched_sift(pos);
+}
+
+// Scheduler suspended. Points the one-shot timer at the head of the table.
+static void led_sched_arm(TickType_t now)
+{
+	if(channel_count == 0U)
+	{
+		xTimerStop(xLedSchedTimer, 0);
+		return;
+	}
+
+	TickType_t next = channels[order[0]].next;
+	TickType_t delay = led_sched_due(next, now) ? 1U : next - now;
+
+	// Zero block time is allowed with the scheduler suspended. Sending the
+	// command here keeps it in order with the table it was computed from.
+	xTimerChangePeriod(xLedSchedTimer, delay, 0);
+}
+
+// Starts the period that began at "start". When that is in the past the pins
+// take the state of the current point of the period, not of its beginning.
+static void led_sched_begin(led_sched_channel *c, TickType_t start, TickType_t now, uint16_t *set, uint16_t *clear)
+{
+	uint16_t mask = c->config->mask;
+
+	c->start = start;
+	c->runs++;
+	c->on = 0;
+	if((TickType_t)(now - start) < c->on_ticks)
+	{
+		*set |= mask;
+		*clear &= ~mask;
+		if(c->on_ticks < c->period)
+		{
+			c->on = 1;
+			c->next = start + c->on_ticks;
+			return;
+		}
+	}
+	else
+	{
+		*clear |= mask;
+		*set &= ~mask;
+	}
+	c->next = start + c->period;
+}
+
+// Handles the deadline at the head of the table, collects the pin changes
+static void led_sched_step(led_sched_channel *c, TickType_t now, uint16_t *set, uint16_t *clear)
+{
+	uint16_t mask = c->config->mask;
+
+	if((TickType_t)(now - c->next) >= c->period)
+	{
+		// A whole period start or more was missed (timer task held off).
+		// Jump to the current period of the original grid instead of
+		// replaying the missed ones back to back.
+		TickType_t anchor = c->on ? c->start : c->next;
+		uint32_t missed = (now - anchor) / c->period; // Period starts after anchor that are due
+
+		c->overruns++;
+		c->skipped += c->on ? missed - 1U : missed;
+		led_sched_begin(c, anchor + missed * c->period, now, set, clear);
+		return;
+	}
+
+	if(c->on)
+	{
+		// Off edge inside the period
+		*clear |= mask;
+		*set &= ~mask;
+		c->on = 0;
+		c->next = c->start + c->period;
+		return;
+	}
+
+	led_sched_begin(c, c->next, now, set, clear);
+}
+
+static void led_sched_callback(TimerHandle_t xTimer)
+{
+	uint16_t set = 0, clear = 0;
+	uint32_t due = 0; // Channels whose period started, callbacks run after the table is unlocked
+
+	vTaskSuspendAll();
+	TickType_t now = xTaskGetTickCount();
+
+	while(channel_count > 0U && led_sched_due(channels[order[0]].next, now))
+	{
+		led_sched_channel *c = &channels[order[0]];
+		uint32_t runs = c->runs;
+
+		led_sched_step(c, now, &set, &clear);
+		if(c->runs != runs)
+		{
+			due |= 1UL << order[0]; // Once per call, also after an overrun
+		}
+		led_sched_sift(0);
+	}
+
+	// Every pin that changes at this tick changes in the same bus write, or
+	// is only stored while a pattern owns it
+	if((set | clear) != 0U)
+	{
+		led_arb_frame(LED_LAYER_BACKGROUND, set, clear);
+	}
+	led_sched_arm(now);
+	xTaskResumeAll();
+
+	for(uint32_t ch = 0; due != 0U; ch++, due >>= 1)
+	{
+		if((due & 1U) && channels[ch].config->callback != NULL)
+		{
+			channels[ch].config->callback();
+		}
+	}
+}
+
+// Returns the channel number, or -1 when the table is full or the timing is invalid
+int led_sched_add(const led_sched_config *config)
+{
+	int channel = -1;
+
+	if(config->period_ms == 0U || config->period_ms > LED_SCHED_MAX_PERIOD_MS || config->duty > 100U)
+	{
+		return -1;
+	}
+
+	vTaskSuspendAll();
+	for(uint32_t ch = 0; ch < LED_SCHED_MAX_CHANNELS; ch++)
+	{
+		if(channels[ch].config == NULL)
+		{
+			led_sched_channel *c = &channels[ch];
+			TickType_t now = xTaskGetTickCount();
+
+			c->config = config;
+			c->runs = 0;
+			c->overruns = 0;
+			c->skipped = 0;
+			led_sched_set_ticks(c, config->period_ms, config->duty);
+
+			order[channel_count] = (uint8_t)ch;
+			channel_count++;
+			led_sched_restart(channel_count - 1U, now + pdMS_TO_TICKS(config->phase_ms));
+			led_sched_arm(now);
+			channel = (int)ch;
+			break;
+		}
+	}
+	xTaskResumeAll();
+
+	return channel;
+}
+
+int led_sched_find(const char *name)
+{
+	for(uint32_t ch = 0; ch < LED_SCHED_MAX_CHANNELS; ch++)
+	{
+		if(channels[ch].config != NULL && strcmp(channels[ch].config->name, name) == 0)
+		{
+			return (int)ch;
+		}
+	}
+	return -1;
+}
+
+// New timing takes effect at once, the channel starts a fresh period now
+int led_sched_set_timing(uint8_t channel, uint32_t period_ms, uint8_t duty)
+{
+	if(channel >= LED_SCHED_MAX_CHANNELS || channels[channel].config == NULL
+			|| period_ms == 0U || period_ms > LED_SCHED_MAX_PERIOD_MS || duty > 100U)
+	{
+		return -1;
+	}
+
+	vTaskSuspendAll();
+	TickType_t now = xTaskGetTickCount();
+
+	led_sched_set_ticks(&channels[channel], period_ms, duty);
+	for(uint8_t pos = 0; pos < channel_count; pos++)
+	{
+		if(order[pos] == channel)
+		{
+			led_sched_restart(pos, now);
+			break;
+		}
+	}
+	led_sched_arm(now);
+	xTaskResumeAll();
+
+	return 0;
+}
+
+const led_sched_config *led_sched_get(uint8_t channel, uint32_t *period_ms, uint8_t *duty, uint32_t *runs)
+{
+	if(channel >= LED_SCHED_MAX_CHANNELS || channels[channel].config == NULL)
+	{
+		return NULL;
+	}
+
+	*period_ms = (channels[channel].period * 1000U) / configTICK_RATE_HZ;
+	*duty = channels[channel].duty;
+	*runs = channels[channel].runs;
+	return channels[channel].config;
+}
+
+int led_sched_overruns(uint8_t channel, uint32_t *overruns, uint32_t *skipped)
+{
+	if(channel >= LED_SCHED_MAX_CHANNELS || channels[channel].config == NULL)
+	{
+		return -1;
+	}
+
+	*overruns = channels[channel].overruns;
+	*skipped = channels[channel].skipped;
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include "log.h"
+#include "timestamp.h"
+
+#define LOG_MAX_FRAME (7U + (LOG_MAX_ARGS * 5U)) // Sync, timestamp, 16-bit ID, 5 bytes per varint
+
+// Starts at the compile-time level, raising it further has no effect
+volatile uint8_t log_threshold[LOG_MOD_COUNT] =
+{
+	[LOG_MOD_BUTTON]  = LOG_MODULE_BUTTON,
+	[LOG_MOD_PATTERN] = LOG_MODULE_PATTERN,
+	[LOG_MOD_LED]     = LOG_MODULE_LED,
+	[LOG_MOD_PWM]     = LOG_MODULE_PWM,
+	[LOG_MOD_KERNEL]  = LOG_MODULE_KERNEL,
+};
+
+const char *const log_module_names[LOG_MOD_COUNT] =
+{
+	[LOG_MOD_BUTTON]  = "button",
+	[LOG_MOD_PATTERN] = "pattern",
+	[LOG_MOD_LED]     = "led",
+	[LOG_MOD_PWM]     = "pwm",
+	[LOG_MOD_KERNEL]  = "kernel",
+};
+
+static void log_emit(uint8_t sync, uint32_t timestamp, const char *fmt, const uint32_t *args, uint32_t nargs)
+{
+	uint8_t frame[LOG_MAX_FRAME];
+	uint16_t id = (uint16_t)(uintptr_t)fmt; // .log_fmt is linked at address 0
+	uint16_t len = 0;
+
+	if(nargs > LOG_MAX_ARGS)
+	{
+		nargs = LOG_MAX_ARGS;
+	}
+
+	frame[len++] = sync;
+	if(sync == LOG_SYNC_TS)
+	{
+		frame[len++] = (uint8_t)timestamp;
+		frame[len++] = (uint8_t)(timestamp >> 8);
+		frame[len++] = (uint8_t)(timestamp >> 16);
+		frame[len++] = (uint8_t)(timestamp >> 24);
+	}
+	frame[len++] = (uint8_t)id;
+	frame[len++] = (uint8_t)(id >> 8);
+
+	for(uint32_t i = 0; i < nargs; i++)
+	{
+		uint32_t value = args[i];
+
+		// LEB128: 7 bits per byte, MSB set on all but the last byte
+		while(value >= 0x80U)
+		{
+			frame[len++] = (uint8_t)(value | 0x80U);
+			value >>= 7;
+		}
+		frame[len++] = (uint8_t)value;
+	}
+
+	console_write_frame(frame, len); // Whole or not at all, a cut frame would desync the decoder
+}
+
+void log_write(const char *fmt, const uint32_t *args, uint32_t nargs)
+{
+#if LOG_TIMESTAMPS
+	log_emit(LOG_SYNC_TS, timestamp_now(), fmt, args, nargs);
+#else
+	log_emit(LOG_SYNC, 0, fmt, args, nargs);
+#endif
+}
+
+void log_write_at(uint32_t timestamp, const char *fmt, const uint32_t *args, uint32_t nargs)
+{
+	log_emit(LOG_SYNC_TS, timestamp, fmt, args, nargs);
+}
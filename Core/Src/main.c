@@ -4,27 +4,85 @@
 #include "led.h"
 #include "button.h"
 #include "pwm.h"
+#include "bam.h"
+#include "waveform.h"
+#include "led_sched.h"
+#include "led_arb.h"
+#include "fade.h"
+#include "patterns.h"
+#include "player.h"
+#include "console.h"
+#include "log.h"
+#include "isr_log.h"
+#include "timestamp.h"
+#include "shell.h"
+#include "telemetry.h"
+#include "clock.h"
+#include "latency.h"
 
 /* Private variables ---------------------------------------------------------*/
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_USART2_UART_Init(void);
 
 int __io_putchar(int ch);
-void vGreenLedControllerTask(void *pvParameters);
-void vBlueLedControllerTask(void *pvParameters);
-void vRedLedControllerTask(void *pvParameters);
 void vButtonControllerTask(void *pvParameters);
-void vPatternGeneratorTask(void *pvParameters);
 
 typedef uint32_t TaskProfiler;
 
 TaskProfiler BlueTaskProfiler, RedTaskProfiler,GreenTaskProfiler;
-TaskHandle_t xBlueTaskHandle, xRedTaskHandle, xGreenTaskHandle;
-QueueHandle_t xPatternQueue;
+fade BlueFade; // Background breathing of the blue LED, restarted by the shell "fade" command
+
+static void green_period_start(void)
+{
+	GreenTaskProfiler++;
+}
+
+#if !PWM_BREATH_DMA
+// The fade advances by the time since the last call, so a late or skipped
+// channel period does not change its speed
+static void blue_fade_step(void)
+{
+	static TickType_t last;
+	static uint8_t started;
+	TickType_t now = xTaskGetTickCount();
+
+	// The first step has nothing to measure from, boot time is not fade time
+	if(!started)
+	{
+		last = now;
+		started = 1;
+	}
+	BlueTaskProfiler++;
+	led_arb_pwm(LED_LAYER_BACKGROUND, fade_step(&BlueFade, (now - last) * portTICK_PERIOD_MS));
+	last = now;
+}
+#endif
+
+static void red_period_start(void)
+{
+	RedTaskProfiler++;
+}
+
+// The LED scheduler channels, timing can be changed from the shell
+static const led_sched_config led_channels[] =
+{
+	{ "green", LED_MASK_GREEN, green_period_start, 1000, 50, 0 },
+#if !PWM_BREATH_DMA
+	{ "blue",  0,              blue_fade_step,     20,   0,  0 }, // With PWM_BREATH_DMA the blue LED needs no channel
+#endif
+	{ "red",   LED_MASK_RED,   red_period_start,   1000, 50, 0 },
+};
+
+// Debounce 20 ms, no double-click, long press at 800 ms, then a repeat every 250 ms. A
+// double-click window would hold every click back by its length before the pattern starts.
+static const button_config user_button = { "user", GPIOC, 13, 1, 20, 0, 800, 250 };
 
 int main(void)
 {
@@ -36,35 +94,43 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_USART2_UART_Init();
+  console_init();
+  timestamp_init();
+  latency_reset();
+  telemetry_init();
   led_gpio_init();
-  button_gpio_init();
+  button_init();
   pwm_init();
+  bam_init();
+  waveform_init();
+  if(CLOCK_DEFAULT_PROFILE != CLOCK_PROFILE_HSI16)
+  {
+	  clock_set_profile(CLOCK_DEFAULT_PROFILE); // Every driver above has registered for the switch
+  }
   set_pwm_duty_cycle(70); // Set initial duty cycle to 50%
   set_pwm_brightness(500); // Set initial brightness to 50%
 
-  xPatternQueue = xQueueCreate(5, sizeof(uint8_t));
+  shell_init();
 
-  xTaskCreate(vGreenLedControllerTask,
-		  	  "Green Led",
-			  128,
-			  NULL,
-			  2,
-			  &xGreenTaskHandle);
-
-  xTaskCreate(vBlueLedControllerTask,
-		  	  "PWM Blue Led",
-			  128,
-			  NULL,
-			  2,
-			  &xBlueTaskHandle);
+  if(button_add(&user_button) < 0)
+  {
+	  LOG_ERROR(BUTTON, "Button %s not added\n\r", user_button.name);
+  }
 
-  xTaskCreate(vRedLedControllerTask,
- 		  	  "Red Led",
- 			  128,
- 			  NULL,
- 			  2,
- 			  &xRedTaskHandle);
+  fade_start(&BlueFade, 0, FADE_LEVEL_MAX, 2000, FADE_SINE, FADE_BOUNCE);
+  led_sched_init();
+  for(uint32_t i = 0; i < sizeof(led_channels) / sizeof(led_channels[0]); i++)
+  {
+	  led_sched_add(&led_channels[i]);
+  }
+#if PWM_BREATH_DMA
+  if(pwm_breath_start(PWM_BREATH_MS) == 0)
+  {
+	  led_arb_pwm(LED_LAYER_BACKGROUND, PWM_BRIGHTNESS_BREATH);
+  }
+#endif
 
   xTaskCreate(vButtonControllerTask,
 		  	  "Button Controller",
@@ -78,156 +144,90 @@ int main(void)
 			  256,
 			  NULL,
 			  1,
+			  &xPatternTaskHandle);
+
+  xTaskCreate(vShellTask,
+		  	  "Shell",
+			  256,
+			  NULL,
+			  2,
 			  NULL);
 
+  xTaskCreate(vLogDrainTask,
+		  	  "Log Drain",
+			  128,
+			  NULL,
+			  1,
+			  NULL);
+
+  xTaskCreate(vTelemetryTask,
+		  	  "Telemetry",
+			  128,
+			  NULL,
+			  1,
+			  NULL);
+
+  telemetry_register_u32("green_count", &GreenTaskProfiler);
+  telemetry_register_u32("blue_count", &BlueTaskProfiler);
+  telemetry_register_u32("red_count", &RedTaskProfiler);
+  telemetry_register("heap_free", telemetry_read_heap_free, NULL, 0);
+  telemetry_register("pattern_queue", player_read_queue_fill, NULL, 0);
+  telemetry_register_u32("press_latency_us", &latency_hists[LATENCY_FIRST_EDGE].last_us);
+  telemetry_register("button_stack", telemetry_read_stack_free, xButtonTaskHandle, TELEMETRY_SLOW);
+
   button_enable_interrupt();
   vTaskStartScheduler();
 
+  // Only reached when the heap is too small for the idle or timer task
+  LOG_ERROR(KERNEL, "Scheduler failed to start, %u bytes of heap free\n\r", xPortGetFreeHeapSize());
+
   while (1)
   {
 
   }
 }
 
-void vGreenLedControllerTask(void *pvParameters)
-{
-	TickType_t xLastWakeTime = xTaskGetTickCount();
-	const TickType_t xFrequency = pdMS_TO_TICKS(500);
-
-	while(1)
-	{
-		GreenTaskProfiler++;
-		led_on(10);
-		vTaskDelayUntil(&xLastWakeTime, xFrequency);
-		led_off(10);
-		vTaskDelayUntil(&xLastWakeTime, xFrequency);
-	}
-}
-
-void vBlueLedControllerTask(void *pvParameters)
-{
-	TickType_t xLastWakeTime = xTaskGetTickCount();
-	const TickType_t xFrequency = pdMS_TO_TICKS(100);
-
-	while(1)
-	{
-		BlueTaskProfiler++;
-		pwm_fade();
-		vTaskDelayUntil(&xLastWakeTime, xFrequency);
-
-	}
-}
-
-void vRedLedControllerTask(void *pvParameters)
-{
-	TickType_t xLastWakeTime = xTaskGetTickCount();
-	const TickType_t xFrequency = pdMS_TO_TICKS(500);
-
-	while(1)
-	{
-		RedTaskProfiler++;
-
-		led_on(12);
-		vTaskDelayUntil(&xLastWakeTime, xFrequency);
-		led_off(12);
-		vTaskDelayUntil(&xLastWakeTime, xFrequency);
-	}
-}
-
-void vPatternGeneratorTask(void *pvParameters)
-{
-	uint8_t receivedPattern;
-
-	while(1)
-	{
-		// Wait indefinitely for a pattern from the queue
-		if(xQueueReceive(xPatternQueue, &receivedPattern, portMAX_DELAY) == pdPASS)
-		{
-			printf("Pattern Generator Task received pattern: %u\n\r", receivedPattern);
-
-			// Suspend normal LED tasks during pattern execution
-			vTaskSuspend(xGreenTaskHandle);
-			vTaskSuspend(xBlueTaskHandle);
-			vTaskSuspend(xRedTaskHandle);
-			led_off(10); // Ensure Green LED is off
-			led_off(12); // Ensure Red LED is off
-			set_pwm_duty_cycle(0); // Ensure PWM is off
-
-			// Execute the received pattern
-			switch(receivedPattern)
-			{
-				case 0:
-					printf("Executing Pattern 0: Blink Green LED 3 times\n\r");
-					led_off(11); // Ensure Blue LED is off
-					set_pwm_duty_cycle(0); // Ensure PWM is off
-					for(int i = 0; i < 3; i++)
-					{
-						led_on(10);
-						vTaskDelay(300);
-						led_off(10);
-						vTaskDelay(300);
-					}
-					break;
-
-				case 1:
-					printf("Executing Pattern 1: Fade Blue LED in and out\n\r");
-					led_off(10); // Ensure Green LED is off
-					led_off(12); // Ensure Red LED is off
-					for(int duty = 0; duty <= 100; duty += 20)
-					{
-						set_pwm_duty_cycle(duty);
-						vTaskDelay(200);
-					}
-					for(int duty = 100; duty >= 0; duty -= 20)
-					{
-						set_pwm_duty_cycle(duty);
-						vTaskDelay(200);
-					}
-					set_pwm_duty_cycle(0); // Turn off after fading
-					break;
-
-				case 2:
-					printf("Executing Pattern 2: Blink Red LED 5 times\n\r");
-					led_off(10); // Ensure Green LED is off
-					set_pwm_duty_cycle(0); // Ensure PWM is off
-					for(int i = 0; i < 5; i++)
-					{
-						led_on(12);
-						vTaskDelay(200);
-						led_off(12);
-						vTaskDelay(200);
-					}
-					break;
-
-				default:
-					printf("Unknown pattern received: %u\n\r", receivedPattern);
-					break;
-			}
-
-			// Resume normal LED tasks after pattern execution
-			vTaskResume(xGreenTaskHandle);
-			vTaskResume(xBlueTaskHandle);
-			vTaskResume(xRedTaskHandle);
-			printf("Resumed LED controller tasks after pattern execution\n\r");
-		}
-	}
-}
-
 void vButtonControllerTask(void *pvParameters)
 {
-    printf("=== BUTTON TASK STARTED ===\n\r");
+    LOG_INFO(BUTTON, "=== BUTTON TASK STARTED ===\n\r");
 
     while(1)
     {
     	static uint8_t pattern = 0;
+    	uint8_t count = pattern_count() ? pattern_count() : 1U;
+    	button_event event;
+
+    	latency_drain(); // Bins what the last event, and the pattern it started, timed
+
         // Wait with timeout to show task is alive
-        uint32_t notification = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5000)); // 5 second timeout
+        if(button_get_event(&event, pdMS_TO_TICKS(5000)) != pdTRUE) // 5 second timeout
+        {
+        	continue;
+        }
+
+        switch(event.type)
+        {
+        	case BUTTON_CLICK:
+        	case BUTTON_REPEAT:       // Held down, keeps stepping
+        		pattern = (pattern + 1U) % count; // Cycle through the pattern IDs
+        		break;
+
+        	case BUTTON_LONG_PRESS:
+        		pattern = 0;
+        		break;
+
+        	default:
+        		continue; // End of a hold, nothing to start
+        }
 
-        if(notification > 0)
+        // Starts or queues the pattern before it returns, never blocks
+        if(player_request(pattern, 0, event.time_us) != 0)
+        {
+            LOG_WARN(BUTTON, "Pattern %u dropped\n\r", pattern);
+        }
+        else
         {
-            pattern = (pattern + 1) % 3; // Cycle through patterns 0, 1, 2
-            xQueueSend(xPatternQueue, &pattern, portMAX_DELAY);
-            printf("Pattern %u sent to Pattern Generator Task\n\r", pattern);
+            LOG_INFO(BUTTON, "Pattern %u requested (%s)\n\r", pattern, button_event_names[event.type]);
         }
     }
 }
@@ -308,15 +308,15 @@ static void MX_USART2_UART_Init(void)
   {
     Error_Handler();
   }
-  if (HAL_UARTEx_SetTxFifoThreshold(&huart2, UART_TXFIFO_THRESHOLD_1_8) != HAL_OK)
+  if (HAL_UARTEx_SetTxFifoThreshold(&huart2, UART_TXFIFO_THRESHOLD_8_8) != HAL_OK)
   {
     Error_Handler();
   }
-  if (HAL_UARTEx_SetRxFifoThreshold(&huart2, UART_RXFIFO_THRESHOLD_1_8) != HAL_OK)
+  if (HAL_UARTEx_SetRxFifoThreshold(&huart2, UART_RXFIFO_THRESHOLD_3_4) != HAL_OK)
   {
     Error_Handler();
   }
-  if (HAL_UARTEx_DisableFifoMode(&huart2) != HAL_OK)
+  if (HAL_UARTEx_EnableFifoMode(&huart2) != HAL_OK)
   {
     Error_Handler();
   }
@@ -326,6 +326,25 @@ static void MX_USART2_UART_Init(void)
 
 }
 
+/**
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void)
+{
+
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Channel1_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+  /* DMA1_Channel2_3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel2_3_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -340,7 +359,7 @@ static void MX_GPIO_Init(void)
 
 /**
   * @brief  Period elapsed callback in non blocking mode
-  * @note   This function is called  when TIM1 interrupt took place, inside
+  * @note   This function is called  when TIM17 interrupt took place, inside
   * HAL_TIM_IRQHandler(). It makes a direct call to HAL_IncTick() to increment
   * a global variable "uwTick" used as application time base.
   * @param  htim : TIM handle
@@ -351,7 +370,7 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
   /* USER CODE BEGIN Callback 0 */
 
   /* USER CODE END Callback 0 */
-  if (htim->Instance == TIM1) {
+  if (htim->Instance == TIM17) {
     HAL_IncTick();
   }
   /* USER CODE BEGIN Callback 1 */
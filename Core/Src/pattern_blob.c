@@ -0,0 +1,24 @@
+// Generated by Tools/pattern_compile.py from Patterns/default.pat, do not edit
+
+#include <stdint.h>
+
+// Placed in the PATTERNS flash region, read through patterns.c
+__attribute__((section(".patterns"), used, aligned(4)))
+const uint8_t pattern_blob[179] =
+{
+	0x50, 0x41, 0x54, 0x42, 0x01, 0x02, 0x05, 0x00, 0xB3, 0x00, 0x00, 0x00,
+	0x18, 0x00, 0x28, 0x00, 0x37, 0x00, 0x45, 0x00, 0x9F, 0x00, 0xB3, 0x00,
+	0x05, 0x03, 0x01, 0x00, 0x04, 0x04, 0x2C, 0x01, 0x02, 0x00, 0x04, 0x04,
+	0x2C, 0x01, 0x06, 0x00, 0x07, 0x00, 0x00, 0xE7, 0x03, 0xB0, 0x04, 0x07,
+	0xE7, 0x03, 0x00, 0x00, 0xB0, 0x04, 0x00, 0x05, 0x05, 0x01, 0x00, 0x10,
+	0x09, 0xC8, 0x02, 0x00, 0x10, 0x09, 0xC8, 0x06, 0x00, 0x05, 0x03, 0x03,
+	0x00, 0x00, 0x09, 0x28, 0x03, 0x96, 0x00, 0x09, 0x28, 0x03, 0x90, 0x01,
+	0x09, 0x28, 0x03, 0xBC, 0x02, 0x09, 0x28, 0x03, 0xE7, 0x03, 0x09, 0x28,
+	0x03, 0xBC, 0x02, 0x09, 0x28, 0x03, 0x90, 0x01, 0x09, 0x28, 0x03, 0x96,
+	0x00, 0x09, 0x28, 0x03, 0x00, 0x00, 0x09, 0xC8, 0x03, 0x96, 0x00, 0x09,
+	0x28, 0x03, 0x90, 0x01, 0x09, 0x28, 0x03, 0xBC, 0x02, 0x09, 0x28, 0x03,
+	0xE7, 0x03, 0x09, 0x28, 0x03, 0xBC, 0x02, 0x09, 0x28, 0x03, 0x90, 0x01,
+	0x09, 0x28, 0x03, 0x96, 0x00, 0x09, 0x28, 0x03, 0x00, 0x00, 0x04, 0x30,
+	0x02, 0x06, 0x00, 0x05, 0x04, 0x01, 0x00, 0x04, 0x09, 0x64, 0x02, 0x00,
+	0x04, 0x01, 0x00, 0x10, 0x09, 0x64, 0x02, 0x00, 0x10, 0x06, 0x00,
+};
@@ -0,0 +1,305 @@
+//LED pattern bytecode interpreter, see pattern_vm.h. No HAL or kernel calls.
+
+#include <stddef.h>
+
+#include "pattern_vm.h"
+
+// Instruction length in bytes including the opcode, 0 = unknown opcode
+static uint16_t pattern_vm_size(uint8_t op)
+{
+	switch(op)
+	{
+		case PATTERN_VM_OP_END:
+		case PATTERN_VM_OP_NEXT:
+			return 1U;
+		case PATTERN_VM_OP_LOOP:
+		case PATTERN_VM_OP_PWMD:
+		case PATTERN_VM_OP_WAITB:
+			return 2U;
+		case PATTERN_VM_OP_SET:
+		case PATTERN_VM_OP_CLEAR:
+		case PATTERN_VM_OP_PWM:
+		case PATTERN_VM_OP_WAIT:
+			return 3U;
+		case PATTERN_VM_OP_RAMP:
+			return 7U;
+		default:
+			return 0U;
+	}
+}
+
+static uint16_t pattern_vm_u16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Walks the code once. Returns the playback length in ms, or PATTERN_VM_ERROR
+// for an unknown opcode, a truncated instruction, an out-of-range level, a
+// PWMD with no level to start from, a LOOP count of 0, unbalanced or too deep
+// LOOP/NEXT, a loop body that takes no time, or a missing END.
+int32_t pattern_vm_check(const uint8_t *code, uint16_t length)
+{
+	uint64_t elapsed = 0;
+	uint64_t start[PATTERN_VM_MAX_DEPTH];
+	uint8_t count[PATTERN_VM_MAX_DEPTH];
+	uint8_t depth = 0;
+	uint8_t level_set = 0;
+	uint16_t pc = 0;
+
+	while(pc < length)
+	{
+		uint8_t op = code[pc];
+		uint16_t size = pattern_vm_size(op);
+		const uint8_t *arg = &code[pc + 1U];
+
+		if(size == 0U || (uint32_t)pc + size > length)
+		{
+			return PATTERN_VM_ERROR;
+		}
+
+		switch(op)
+		{
+			case PATTERN_VM_OP_END:
+				return (depth == 0U && elapsed <= INT32_MAX) ? (int32_t)elapsed : PATTERN_VM_ERROR;
+
+			case PATTERN_VM_OP_PWM:
+				if(pattern_vm_u16(arg) > PATTERN_VM_PWM_MAX)
+				{
+					return PATTERN_VM_ERROR;
+				}
+				level_set = 1;
+				break;
+
+			case PATTERN_VM_OP_PWMD:
+				if(!level_set)
+				{
+					return PATTERN_VM_ERROR;
+				}
+				break;
+
+			case PATTERN_VM_OP_WAIT:
+				elapsed += pattern_vm_u16(arg);
+				break;
+
+			case PATTERN_VM_OP_WAITB:
+				elapsed += arg[0];
+				break;
+
+			case PATTERN_VM_OP_RAMP:
+				if(pattern_vm_u16(arg) > PATTERN_VM_PWM_MAX || pattern_vm_u16(arg + 2) > PATTERN_VM_PWM_MAX)
+				{
+					return PATTERN_VM_ERROR;
+				}
+				elapsed += pattern_vm_u16(arg + 4);
+				level_set = 1;
+				break;
+
+			case PATTERN_VM_OP_LOOP:
+				if(arg[0] == 0U || depth >= PATTERN_VM_MAX_DEPTH)
+				{
+					return PATTERN_VM_ERROR;
+				}
+				start[depth] = elapsed;
+				count[depth] = arg[0];
+				depth++;
+				break;
+
+			case PATTERN_VM_OP_NEXT:
+				if(depth == 0U)
+				{
+					return PATTERN_VM_ERROR;
+				}
+				depth--;
+				// A body that takes no time would spin without yielding
+				if(elapsed == start[depth])
+				{
+					return PATTERN_VM_ERROR;
+				}
+				elapsed = start[depth] + (elapsed - start[depth]) * count[depth];
+				break;
+
+			default:
+				break;
+		}
+		pc += size;
+	}
+
+	return PATTERN_VM_ERROR;
+}
+
+void pattern_vm_init(pattern_vm *vm, const uint8_t *code, uint16_t length, const pattern_vm_io *io)
+{
+	vm->code = code;
+	vm->io = io;
+	vm->length = length;
+	vm->pc = 0;
+	vm->depth = 0;
+	vm->ramping = 0;
+	vm->level = 0;
+}
+
+static void pattern_vm_pwm(pattern_vm *vm, uint16_t level)
+{
+	vm->level = level;
+	vm->io->pwm(level);
+}
+
+// Output of the next RAMP step, returns how long it holds
+static int32_t pattern_vm_ramp_step(pattern_vm *vm)
+{
+	pattern_vm_pwm(vm, (uint16_t)(vm->ramp_level >> 16));
+	return (vm->ramp_steps == 1U) ? vm->ramp_last_ms : PATTERN_VM_RAMP_STEP_MS;
+}
+
+// Runs until the outputs must be held. Returns the hold time in ms, 0 when the
+// pattern has ended, or PATTERN_VM_ERROR. Code that passed pattern_vm_check()
+// executes fewer than 2 * length instructions per call.
+int32_t pattern_vm_run(pattern_vm *vm)
+{
+	uint16_t set = 0, clear = 0;
+	int32_t hold = 0;
+	uint32_t ops = 0;
+
+	if(vm->ramping)
+	{
+		vm->ramp_steps--;
+		if(vm->ramp_steps != 0U)
+		{
+			vm->ramp_level += vm->ramp_delta;
+			return pattern_vm_ramp_step(vm);
+		}
+		vm->ramping = 0;
+		pattern_vm_pwm(vm, vm->ramp_to); // Exact end level, no rounding left over
+	}
+
+	while(hold == 0)
+	{
+		uint16_t pc = vm->pc;
+
+		if(pc >= vm->length || ++ops > 2U * vm->length)
+		{
+			hold = PATTERN_VM_ERROR;
+			break;
+		}
+
+		uint8_t op = vm->code[pc];
+		uint16_t size = pattern_vm_size(op);
+		const uint8_t *arg = &vm->code[pc + 1U];
+
+		if(size == 0U || (uint32_t)pc + size > vm->length)
+		{
+			hold = PATTERN_VM_ERROR;
+			break;
+		}
+		vm->pc = pc + size;
+
+		switch(op)
+		{
+			case PATTERN_VM_OP_END:
+				vm->pc = pc; // Stay on END, later calls return 0 again
+				if(set | clear)
+				{
+					vm->io->frame(set, clear);
+				}
+				return 0;
+
+			case PATTERN_VM_OP_SET:
+				set |= pattern_vm_u16(arg);
+				clear &= ~pattern_vm_u16(arg);
+				break;
+
+			case PATTERN_VM_OP_CLEAR:
+				clear |= pattern_vm_u16(arg);
+				set &= ~pattern_vm_u16(arg);
+				break;
+
+			case PATTERN_VM_OP_PWM:
+				pattern_vm_pwm(vm, pattern_vm_u16(arg));
+				break;
+
+			case PATTERN_VM_OP_PWMD:
+			{
+				int32_t level = (int32_t)vm->level + (int8_t)arg[0];
+
+				// The compiler never leaves the range, clamp what hand-written code does
+				if(level < 0)
+				{
+					level = 0;
+				}
+				else if(level > (int32_t)PATTERN_VM_PWM_MAX)
+				{
+					level = PATTERN_VM_PWM_MAX;
+				}
+				pattern_vm_pwm(vm, (uint16_t)level);
+				break;
+			}
+
+			case PATTERN_VM_OP_WAIT:
+				hold = pattern_vm_u16(arg);
+				break;
+
+			case PATTERN_VM_OP_WAITB:
+				hold = arg[0];
+				break;
+
+			case PATTERN_VM_OP_LOOP:
+				if(vm->depth >= PATTERN_VM_MAX_DEPTH)
+				{
+					hold = PATTERN_VM_ERROR;
+					break;
+				}
+				vm->loop[vm->depth].start = vm->pc;
+				vm->loop[vm->depth].remaining = (uint8_t)(arg[0] - 1U);
+				vm->depth++;
+				break;
+
+			case PATTERN_VM_OP_NEXT:
+				if(vm->depth == 0U)
+				{
+					hold = PATTERN_VM_ERROR;
+				}
+				else if(vm->loop[vm->depth - 1U].remaining != 0U)
+				{
+					vm->loop[vm->depth - 1U].remaining--;
+					vm->pc = vm->loop[vm->depth - 1U].start;
+				}
+				else
+				{
+					vm->depth--;
+				}
+				break;
+
+			case PATTERN_VM_OP_RAMP:
+			{
+				uint16_t from = pattern_vm_u16(arg);
+				uint16_t ms = pattern_vm_u16(arg + 4);
+
+				vm->ramp_to = pattern_vm_u16(arg + 2);
+				if(ms == 0U)
+				{
+					pattern_vm_pwm(vm, vm->ramp_to);
+					break;
+				}
+				// The one division of the ramp, the steps only add
+				vm->ramp_steps = (uint16_t)((ms + PATTERN_VM_RAMP_STEP_MS - 1U) / PATTERN_VM_RAMP_STEP_MS);
+				vm->ramp_last_ms = (uint16_t)(ms - (vm->ramp_steps - 1U) * PATTERN_VM_RAMP_STEP_MS);
+				vm->ramp_level = (int32_t)from << 16;
+				vm->ramp_delta = (((int32_t)vm->ramp_to - (int32_t)from) * 65536) / vm->ramp_steps;
+				vm->ramping = 1;
+				hold = pattern_vm_ramp_step(vm);
+				break;
+			}
+
+			default:
+				hold = PATTERN_VM_ERROR;
+				break;
+		}
+	}
+
+	// Every pin change of this instant in one write
+	if(hold > 0 && (set | clear))
+	{
+		vm->io->frame(set, clear);
+	}
+	return hold;
+}
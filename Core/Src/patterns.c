@@ -0,0 +1,60 @@
+//Pattern lookup in the flash pattern blob, see patterns.h
+
+#include <stddef.h>
+
+#include "patterns.h"
+
+// The whole PATTERNS region, from the linker script
+extern const uint8_t __patterns_start[];
+extern const uint8_t __patterns_end[];
+
+// NULL when the region holds no blob this firmware can play
+static const pattern_blob_header *pattern_blob(void)
+{
+	const pattern_blob_header *blob = (const pattern_blob_header *)__patterns_start;
+	uint32_t region = (uint32_t)(__patterns_end - __patterns_start);
+
+	if(region < sizeof(pattern_blob_header)
+			|| blob->magic != PATTERN_BLOB_MAGIC
+			|| blob->version != PATTERN_BLOB_VERSION
+			|| blob->vm_version != PATTERN_VM_VERSION
+			|| blob->size > region
+			|| sizeof(pattern_blob_header) + (blob->count + 1U) * sizeof(uint16_t) > blob->size)
+	{
+		return NULL;
+	}
+	return blob;
+}
+
+uint8_t pattern_count(void)
+{
+	const pattern_blob_header *blob = pattern_blob();
+
+	if(blob == NULL)
+	{
+		return 0;
+	}
+	return (blob->count > 255U) ? 255U : (uint8_t)blob->count;
+}
+
+// Returns NULL for an unknown or unused ID
+const uint8_t *pattern_get(uint8_t id, uint16_t *length)
+{
+	const pattern_blob_header *blob = pattern_blob();
+
+	if(blob == NULL || id >= blob->count)
+	{
+		return NULL;
+	}
+
+	uint16_t start = blob->offset[id];
+	uint16_t end = blob->offset[id + 1U];
+
+	if(start >= end || end > blob->size)
+	{
+		return NULL;
+	}
+
+	*length = end - start;
+	return (const uint8_t *)blob + start;
+}
@@ -0,0 +1,264 @@
+//Pattern player, requests preempt or queue behind the running pattern, see player.h
+
+#include "player.h"
+#include "led.h"
+#include "log.h"
+#include "led_arb.h"
+#include "patterns.h"
+#include "pattern_vm.h"
+#include "waveform.h"
+#include "timestamp.h"
+#include "latency.h"
+
+typedef struct
+{
+	uint8_t id;
+	uint8_t priority;
+	uint32_t origin_us;
+	uint32_t duration_ms; // From pattern_vm_check() at request time
+} player_entry;
+
+PlayerProfiler PlayerStats;
+TaskHandle_t xPatternTaskHandle = NULL;
+
+const char *const player_policy_names[PLAYER_POLICY_COUNT] = { "latest", "queue", "priority" };
+
+static player_policy policy = PLAYER_DEFAULT_POLICY;
+static player_entry queue[PLAYER_QUEUE_LEN]; // Waiting requests, queue[0] plays next
+static uint8_t queue_count;
+static uint8_t playing;          // The LEDs are claimed on the pattern layer
+static uint8_t current_priority;
+static TickType_t current_end;   // Tick by which the running pattern has ended
+
+static void player_frame(uint16_t set_mask, uint16_t clear_mask)
+{
+	led_arb_frame(LED_LAYER_PATTERN, set_mask, clear_mask);
+}
+
+static void player_pwm(uint16_t level)
+{
+	led_arb_pwm(LED_LAYER_PATTERN, level);
+}
+
+static const pattern_vm_io player_io = { player_frame, player_pwm };
+static pattern_vm player_vm;
+
+// Scheduler suspended. Cancels whatever plays and starts the pattern, its
+// first outputs are written before this returns. Returns 1 when the pattern
+// task must be notified because TIM7 will not do it.
+static uint8_t player_start(const player_entry *entry)
+{
+	uint16_t length;
+	const uint8_t *code = pattern_get(entry->id, &length);
+
+	// The code was checked by player_request(), this is only the O(1) lookup
+	if(code == NULL)
+	{
+		PlayerStats.dropped++;
+		return 1;
+	}
+
+	waveform_stop();
+	// Clean slate, the new pattern starts from all off. The LED scheduler
+	// keeps running underneath and shows again on release.
+	if(!playing)
+	{
+		led_arb_claim(LED_LAYER_PATTERN, LED_MASK_ALL);
+		playing = 1;
+	}
+	else
+	{
+		led_arb_frame(LED_LAYER_PATTERN, 0, LED_MASK_ALL);
+		led_arb_pwm(LED_LAYER_PATTERN, 0);
+	}
+
+	pattern_vm_init(&player_vm, code, length, &player_io);
+	int result = waveform_run(&player_vm, xPatternTaskHandle);
+
+	latency_since(LATENCY_FIRST_EDGE, entry->origin_us);
+
+	current_priority = entry->priority;
+	current_end = xTaskGetTickCount() + pdMS_TO_TICKS(entry->duration_ms);
+	PlayerStats.started++;
+
+	return result != 0; // Ended at once, nothing for TIM7 to time
+}
+
+// Scheduler suspended
+static int player_enqueue(const player_entry *entry)
+{
+	uint8_t pos = queue_count;
+
+	if(queue_count >= PLAYER_QUEUE_LEN)
+	{
+		PlayerStats.dropped++;
+		return -1;
+	}
+
+	// Highest priority first, FIFO among equals. In queue mode all are 0.
+	while(pos > 0U && queue[pos - 1U].priority < entry->priority)
+	{
+		queue[pos] = queue[pos - 1U];
+		pos--;
+	}
+	queue[pos] = *entry;
+	queue_count++;
+	PlayerStats.queued++;
+	return 0;
+}
+
+// Starts the pattern, cancels or queues behind the running one depending on
+// the policy. Never blocks. Returns -1 when the pattern is unknown or invalid,
+// or when it would have to wait and the queue is full.
+int player_request(uint8_t id, uint8_t priority, uint32_t origin_us)
+{
+	uint16_t length;
+	const uint8_t *code = pattern_get(id, &length);
+	int32_t duration_ms = (code != NULL) ? pattern_vm_check(code, length) : PATTERN_VM_ERROR;
+	player_entry entry = { id, priority, origin_us, (uint32_t)duration_ms };
+	uint8_t notify = 0;
+	int result = 0;
+
+	// The only walk over the code, before the scheduler is suspended;
+	// player_start() reuses the duration it gives
+	if(duration_ms < 0)
+	{
+		PlayerStats.dropped++;
+		return -1;
+	}
+
+	vTaskSuspendAll();
+	PlayerStats.requests++;
+	if(policy == PLAYER_QUEUE)
+	{
+		entry.priority = 0;
+	}
+
+	if(!playing || policy == PLAYER_LATEST || (policy == PLAYER_PRIORITY && priority > current_priority))
+	{
+		if(playing)
+		{
+			PlayerStats.preempted++;
+		}
+		if(policy == PLAYER_LATEST)
+		{
+			queue_count = 0; // Left over from an earlier policy
+		}
+		notify = player_start(&entry);
+	}
+	else
+	{
+		result = player_enqueue(&entry);
+	}
+	xTaskResumeAll();
+
+	// Not while suspended, the notification can make the task ready
+	if(notify && xPatternTaskHandle != NULL)
+	{
+		xTaskNotifyGive(xPatternTaskHandle);
+	}
+	return result;
+}
+
+void player_set_policy(player_policy new_policy)
+{
+	if(new_policy < PLAYER_POLICY_COUNT)
+	{
+		policy = new_policy;
+	}
+}
+
+player_policy player_get_policy(void)
+{
+	return policy;
+}
+
+uint8_t player_queue_fill(void)
+{
+	return queue_count;
+}
+
+uint32_t player_read_queue_fill(const void *arg)
+{
+	(void)arg;
+	return queue_count;
+}
+
+// Handles the end of a pattern only, starting one is done by the requester
+void vPatternGeneratorTask(void *pvParameters)
+{
+	while(1)
+	{
+		TickType_t wait = portMAX_DELAY;
+		uint8_t notify = 0, overrun = 0, idle = 0;
+
+		vTaskSuspendAll();
+		if(playing)
+		{
+			int32_t left = (int32_t)(current_end - xTaskGetTickCount());
+
+			wait = pdMS_TO_TICKS(PLAYER_GRACE_MS) + ((left > 0) ? (TickType_t)left : 0U);
+		}
+		xTaskResumeAll();
+
+		uint32_t ended = ulTaskNotifyTake(pdTRUE, wait);
+		uint32_t end_us;
+
+		if(ended && waveform_ended(&end_us))
+		{
+			latency_since(LATENCY_PATTERN_WAKE, end_us); // TIM7 end to this task running
+		}
+
+		vTaskSuspendAll();
+		if(playing && (!ended || !waveform_busy()))
+		{
+			// A notification while TIM7 is busy is from a pattern that a
+			// request has already replaced, the new one is still playing
+			if(ended)
+			{
+				PlayerStats.completed++;
+			}
+			else if((int32_t)(xTaskGetTickCount() - current_end) >= (int32_t)pdMS_TO_TICKS(PLAYER_GRACE_MS))
+			{
+				waveform_stop();
+				PlayerStats.overruns++;
+				overrun = 1;
+			}
+
+			if(!waveform_busy())
+			{
+				if(queue_count > 0U)
+				{
+					player_entry next = queue[0];
+
+					queue_count--;
+					for(uint8_t i = 0; i < queue_count; i++)
+					{
+						queue[i] = queue[i + 1U];
+					}
+					notify = player_start(&next);
+				}
+				else
+				{
+					playing = 0;
+					led_arb_release(LED_LAYER_PATTERN, LED_MASK_ALL);
+					idle = 1;
+				}
+			}
+		}
+		xTaskResumeAll();
+
+		if(notify)
+		{
+			xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+		}
+		if(overrun)
+		{
+			LOG_WARN(PATTERN, "Pattern did not finish in time, stopped\n\r");
+		}
+		if(idle)
+		{
+			LOG_DEBUG(PATTERN, "LEDs back to the LED scheduler after pattern execution\n\r");
+		}
+	}
+}
@@ -1,95 +1,457 @@
-//PC11 - BLUE LED as PWM output
+//PWM on the LED pins: PC10 green TIM1_CH3, PC11 blue TIM1_CH4, PC12 red TIM14_CH1
 
 #include "pwm.h"
+#include "timer_alloc.h"
+#include "fade.h"
+#include "clock.h"
 
-#define RCC_CFGR_PPRE1_DIV1 (1U<<12) // APB1 prescaler = 1
+typedef struct
+{
+	TIM_TypeDef *tim;
+	volatile uint32_t *ccr; // CCRx of the channel
+	uint8_t timer;          // TIMER_xxx of timer_alloc.h
+	uint8_t channel;        // 1..4
+	uint8_t pin;            // GPIOC pin, AF2 on all three
+} pwm_channel_desc;
+
+static const pwm_channel_desc channels[PWM_CHANNEL_COUNT] =
+{
+	[PWM_RED]   = { TIM14, &TIM14->CCR1, TIMER_FOR_PWM_RED, 1, 12 },
+	[PWM_GREEN] = { TIM1,  &TIM1->CCR3,  TIMER_FOR_PWM,     3, 10 },
+	[PWM_BLUE]  = { TIM1,  &TIM1->CCR4,  TIMER_FOR_PWM,     4, 11 },
+};
+
+typedef struct
+{
+	TIM_TypeDef *tim;
+	uint8_t timer;
+} pwm_timer_desc;
+
+// Timers that have PWM channels, their update events are held during pwm_commit()
+static const pwm_timer_desc pwm_timers[] =
+{
+	{ TIM1,  TIMER_FOR_PWM },
+	{ TIM14, TIMER_FOR_PWM_RED },
+};
+
+#define PWM_TIMERS (sizeof(pwm_timers) / sizeof(pwm_timers[0]))
+
+const char *const pwm_channel_names[PWM_CHANNEL_COUNT] = { "red", "green", "blue" };
+
+static uint16_t staged[PWM_CHANNEL_COUNT]; // Compare values for the next pwm_commit()
+static uint8_t staged_mask;
+static uint8_t breath_ready; // pwm_breath_start() has set up the DMA channel
+static uint32_t breath_length_ms;
+static uint16_t breath_scaled[FADE_BREATH_POINTS]; // fade_breath[] for periods other than FADE_BREATH_PERIOD
+
+static uint32_t pwm_freq_hz = PWM_FREQ_HZ; // Asked for, the timers get the nearest they can do
+
+// Stops the breath DMA requests before the CPU writes CCR4. The channel keeps
+// its place in the table. A request taken just before is served within a few
+// bus cycles, before the caller's CCR4 store.
+static void pwm_stop_breath_requests(void)
+{
+	TIM1->DIER &= ~TIM_DIER_UDE;
+	(void)TIM1->DIER;
+}
+
+// Period in counts for freq_hz on a timer clock, and its prescaler: the
+// smallest prescaler, so the longest period that fits the 16-bit ARR and the
+// most resolution, rounded to the nearest frequency. 0 when the clock is too
+// slow for freq_hz.
+static uint32_t pwm_timing(uint32_t clock, uint32_t freq_hz, uint32_t *psc)
+{
+	uint32_t counts = (clock + freq_hz / 2U) / freq_hz; // Per period at PSC 0
+
+	if(counts < 2U)
+	{
+		return 0;
+	}
+
+	uint32_t prescale = (counts + 0xFFFFU) / 0x10000U;
+	uint32_t period = (clock / prescale + freq_hz / 2U) / freq_hz;
+
+	*psc = prescale - 1U;
+	return (period > 0x10000U) ? 0x10000U : period;
+}
+
+// Whole bits of resolution of a period, floor(log2(counts))
+static uint8_t pwm_bits(uint32_t counts)
+{
+	uint8_t bits = 0;
+
+	while(counts > 1U)
+	{
+		counts >>= 1;
+		bits++;
+	}
+	return bits;
+}
+
+// Period of pwm_freq_hz at the timer's clock, CCR preload on
+static void pwm_timer_start(TIM_TypeDef *tim, uint8_t timer)
+{
+	uint32_t psc = 0;
+	uint32_t period = pwm_timing(timer_clock_hz(timer), pwm_freq_hz, &psc);
+
+	tim->PSC = psc; // 0 unless the period would not fit 16 bits, the period sets the resolution
+	tim->ARR = period - 1U; // 15999 at 16 MHz and 1 kHz, about 14 bits
+	if(IS_TIM_BREAK_INSTANCE(tim))
+	{
+		tim->BDTR |= TIM_BDTR_MOE; // Main output enable, advanced-control timers only
+	}
+	tim->CR1 |= TIM_CR1_ARPE | TIM_CR1_URS; // Auto-reload preload, forced updates raise no DMA request
+	tim->EGR |= TIM_EGR_UG; // Generate an update event to load the prescaler value
+	tim->CR1 |= TIM_CR1_CEN; // Start the timer
+}
+
+// Same frequency on the new clock, with the resolution the new clock gives.
+// pwm_set_frequency() warns when the clock is too slow for it.
+static void pwm_clock_changed(clock_event event)
+{
+	if(event == CLOCK_AFTER)
+	{
+		pwm_set_frequency(pwm_freq_hz, 0);
+	}
+}
 
 void pwm_init(void)
 {
-	// Enable GPIOC clock
+	// TIM1 is the only timer on PC11. The HAL timebase used to run on it and
+	// was reprogrammed here, it is on TIM17 now and the claim keeps it that way.
+	if(timer_claim(TIMER_FOR_PWM, TIMER_PART_BASE | TIMER_PART_CH4, TIMER_OWNER_PWM) != 0)
+	{
+		LOG_ERROR(PWM, "TIM1 already claimed, no blue LED PWM\n\r");
+		return;
+	}
+
+	pwm_timer_start(TIM1, TIMER_FOR_PWM);
+	TIM1->CCR4 = 0; // Initial duty cycle 0%
+	pwm_channel_enable(PWM_BLUE);
+	clock_register(pwm_clock_changed);
+}
+
+// Gives the channel's pin to its timer, in PWM mode 1 with CCR preload. A
+// timer that is not running yet is started. -1 when the timer or the channel
+// belongs to another driver.
+int pwm_channel_enable(pwm_channel ch)
+{
+	if(ch >= PWM_CHANNEL_COUNT)
+	{
+		return -1;
+	}
+
+	const pwm_channel_desc *c = &channels[ch];
+	uint32_t pin = c->pin;
+	uint32_t index = c->channel - 1U;
+
+	if(timer_claim(c->timer, TIMER_PART_BASE | (TIMER_PART_CH1 << index), TIMER_OWNER_PWM) != 0)
+	{
+		LOG_ERROR(PWM, "%s already claimed, no %s PWM\n\r", timer_name(c->timer), pwm_channel_names[ch]);
+		return -1;
+	}
+	if((c->tim->CR1 & TIM_CR1_CEN) == 0U)
+	{
+		pwm_timer_start(c->tim, c->timer);
+	}
+
+	// CCMR1 holds channels 1 and 2, CCMR2 channels 3 and 4, 8 bits each
+	volatile uint32_t *ccmr = (index < 2U) ? &c->tim->CCMR1 : &c->tim->CCMR2;
+	uint32_t shift = (index & 1U) * 8U;
+
+	*ccmr = (*ccmr & ~((TIM_CCMR1_OC1M | TIM_CCMR1_CC1S) << shift))
+			| (((6U << TIM_CCMR1_OC1M_Pos) | TIM_CCMR1_OC1PE) << shift); // PWM mode 1, preload
+	c->tim->CCER |= TIM_CCER_CC1E << (4U * index);
+
 	RCC->IOPENR |= RCC_IOPENR_GPIOCEN;
+	GPIOC->OSPEEDR |= (3U << (2*pin));                               // High speed
+	GPIOC->AFR[pin / 8U] = (GPIOC->AFR[pin / 8U] & ~(0xFU << (4U * (pin % 8U)))) | (2U << (4U * (pin % 8U))); // AF2
+	GPIOC->MODER = (GPIOC->MODER & ~(3U << (2*pin))) | (2U << (2*pin)); // Alternate function mode
+	return 0;
+}
+
+// Gives the pin back to GPIO output (led_frame(), the LED scheduler). The
+// channel stays claimed and the timer keeps running.
+void pwm_channel_disable(pwm_channel ch)
+{
+	if(ch >= PWM_CHANNEL_COUNT)
+	{
+		return;
+	}
 
-	// Configure PC11 as alternate function mode
-	GPIOC->MODER &= ~(3U << (2*11));  // Clear mode bits for PC11
-	GPIOC->MODER |= (2U << (2*11));   // PC11 alternate function mode
-	GPIOC->OSPEEDR |= (3U << (2*11)); // PC11 high speed
-	GPIOC->AFR[1] &= ~(0xF << (4*(11-8))); // Clear AF bits for PC11
-	GPIOC->AFR[1] |= (2U << (4*(11-8)));    // Set AF2 for TIM1_CH4
+	const pwm_channel_desc *c = &channels[ch];
 
-	// Enable TIM1 clock
-	RCC->APBENR2 |= RCC_APBENR2_TIM1EN;
-	RCC->CFGR |= RCC_CFGR_PPRE1_DIV1; // APB1 prescaler = 1
+	GPIOC->MODER = (GPIOC->MODER & ~(3U << (2*c->pin))) | (1U << (2*c->pin)); // Output mode
+	c->tim->CCER &= ~(TIM_CCER_CC1E << (4U * (c->channel - 1U)));
+}
 
-	// Configure TIM1 for PWM
-	TIM1->PSC = 79; // Prescaler value (16 MHz clock, 16 MHz / (79 + 1) = 200 kHz timer clock)
-	TIM1->ARR = 999; // Auto-reload value for 1 kHz PWM frequency
-	TIM1->CCR4 = 0; // Initial duty cycle 0%
+// Level 0..999 for the next pwm_commit(), through the gamma table. No
+// hardware access.
+void pwm_stage(pwm_channel ch, uint16_t level)
+{
+	if(ch >= PWM_CHANNEL_COUNT)
+	{
+		return;
+	}
 
-	// Configure PWM mode for channel 4
-	TIM1->CCMR2 &= ~TIM_CCMR2_OC4M; // Clear output compare mode bits for channel 4
-	TIM1->CCMR2 |= (6U << TIM_CCMR2_OC4M_Pos); // PWM mode 1
-	TIM1->CCMR2 |= TIM_CCMR2_OC4PE; // Enable preload for CCR4
+	staged[ch] = fade_gamma_duty(level, channels[ch].tim->ARR + 1U);
+	staged_mask |= 1U << ch;
+}
 
-	// Enable main output for TIM1
-	TIM1->BDTR |= TIM_BDTR_MOE; // Main output enable
+// Ends a hold of the update events (UDIS) and forces one update on every
+// running PWM timer, back to back. The preloaded values of TIM1 and TIM14
+// latch within a few cycles of each other instead of at the next period of
+// each timer, and both start a new period together. URS keeps the forced
+// update from raising a breath DMA request.
+static void pwm_release_updates(void)
+{
+	for(uint32_t t = 0; t < PWM_TIMERS; t++)
+	{
+		pwm_timers[t].tim->CR1 &= ~TIM_CR1_UDIS;
+	}
+	for(uint32_t t = 0; t < PWM_TIMERS; t++)
+	{
+		if(pwm_timers[t].tim->CR1 & TIM_CR1_CEN)
+		{
+			pwm_timers[t].tim->EGR = TIM_EGR_UG;
+		}
+	}
+}
 
-	TIM1->CCER |= TIM_CCER_CC4E; // Enable output for channel 4
+// Writes every staged value with the update events of the PWM timers held
+// (UDIS), then latches them on all timers at once. No frame shows part of
+// the change, on one timer or across both.
+void pwm_commit(void)
+{
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint8_t mask = staged_mask;
 
-	TIM1->CR1 |= TIM_CR1_ARPE; // Enable auto-reload preload
-	TIM1->EGR |= TIM_EGR_UG; // Generate an update event to load the prescaler value
-	TIM1->CR1 |= TIM_CR1_CEN; // Start the timer
+	staged_mask = 0;
+	if(mask & (1U << PWM_BLUE))
+	{
+		pwm_stop_breath_requests();
+	}
+	for(uint32_t t = 0; t < PWM_TIMERS; t++)
+	{
+		pwm_timers[t].tim->CR1 |= TIM_CR1_UDIS;
+	}
+	for(uint32_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+	{
+		if(mask & (1U << ch))
+		{
+			*channels[ch].ccr = staged[ch];
+		}
+	}
+	pwm_release_updates();
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+// All three LED channels in one frame
+void pwm_set_rgb(color_rgb color)
+{
+	pwm_stage(PWM_RED, color.red);
+	pwm_stage(PWM_GREEN, color.green);
+	pwm_stage(PWM_BLUE, color.blue);
+	pwm_commit();
 }
 
 void set_pwm_duty_cycle(uint8_t duty_percent)
 {
 	if(duty_percent > 100)
 	{
+		LOG_WARN(PWM, "Duty cycle %u%% capped at 100%%\n\r", duty_percent);
 		duty_percent = 100; // Cap duty cycle at 100%
 	}
 
+	pwm_stop_breath_requests();
 	TIM1->CCR4 = (TIM1->ARR + 1) * duty_percent / 100; // Update CCR4 for desired duty cycle
 }
 
+// Perceptual level 0..999, through the gamma table onto the full period.
+// PWM_BRIGHTNESS_BREATH streams the breath again, or turns the LED off when
+// pwm_breath_start() has not run.
 void set_pwm_brightness(uint16_t brightness)
 {
+	if(brightness == PWM_BRIGHTNESS_BREATH)
+	{
+		if(breath_ready)
+		{
+			TIM1->DIER |= TIM_DIER_UDE;
+		}
+		else
+		{
+			TIM1->CCR4 = 0;
+		}
+		return;
+	}
+
 	if(brightness > 999)
 	{
+		LOG_WARN(PWM, "Brightness %u capped at 999\n\r", brightness);
 		brightness = 999; // Cap brightness at 100%
 	}
 
-	TIM1->CCR4 = brightness; // Update CCR4 for desired brightness
+	pwm_stop_breath_requests();
+	TIM1->CCR4 = fade_gamma_duty(brightness, TIM1->ARR + 1U);
 }
 
-void pwm_fade(void)
+// Programs the breath DMA for the current TIM1 period with the requests
+// stopped. Periods other than FADE_BREATH_PERIOD get a scaled RAM copy of
+// the table.
+static void pwm_breath_setup(uint32_t breath_ms)
 {
-	static uint16_t brightness = 0;
-	    static uint8_t direction = 1; // 1 = up, 0 = down
+	uint32_t period = TIM1->ARR + 1U;
+	uint32_t frames_per_s = timer_clock_hz(TIMER_FOR_PWM) / ((TIM1->PSC + 1U) * period);
+	uint32_t repeat = (breath_ms * frames_per_s + 500U * FADE_BREATH_POINTS) / (1000U * FADE_BREATH_POINTS);
+	const uint16_t *table = fade_breath;
 
-	    if(direction)
-	    {
-	        brightness += 10;
-	        if(brightness >= 999)
-	        {
-	        	direction = 0;
-	        }
-	    }
-	    else
-	    {
-	        brightness -= 10;
-	        if(brightness <= 0)
-	        {
-	        	direction = 1;
-	        }
-	    }
+	if(repeat == 0U)
+	{
+		repeat = 1U;
+	}
+
+	pwm_stop_breath_requests();
+	RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+	PWM_BREATH_DMA_CHANNEL->CCR &= ~DMA_CCR_EN;
+
+	if(period != FADE_BREATH_PERIOD)
+	{
+		// period / FADE_BREATH_PERIOD in Q16, written so period * 4096 cannot
+		// overflow; the products stay below 2^32 for periods up to 65536
+		uint32_t scale = (period * 4096U) / (FADE_BREATH_PERIOD / 16U);
 
-	    TIM1->CCR4 = brightness;
+		for(uint32_t i = 0; i < FADE_BREATH_POINTS; i++)
+		{
+			breath_scaled[i] = (uint16_t)((fade_breath[i] * scale) >> 16);
+		}
+		table = breath_scaled;
+	}
+
+	PWM_BREATH_DMA_CHANNEL->CPAR = (uint32_t)&TIM1->CCR4;
+	PWM_BREATH_DMA_CHANNEL->CMAR = (uint32_t)table;
+	PWM_BREATH_DMA_CHANNEL->CNDTR = FADE_BREATH_POINTS;
+	PWM_BREATH_DMAMUX->CCR = DMA_REQUEST_TIM1_UP;
+	// Memory to peripheral, 16 bit both sides, circular, low priority, no interrupt
+	PWM_BREATH_DMA_CHANNEL->CCR = DMA_CCR_DIR | DMA_CCR_CIRC | DMA_CCR_MINC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0;
+	PWM_BREATH_DMA_CHANNEL->CCR |= DMA_CCR_EN;
+
+	TIM1->RCR = repeat - 1U; // Preloaded, applies from the next update event
+	breath_length_ms = breath_ms;
+	breath_ready = 1;
 }
 
+// Sets up the breath stream, one breath in about breath_ms (whole multiples
+// of FADE_BREATH_POINTS PWM periods, 1.024 s at 1 kHz). Streaming starts with
+// set_pwm_brightness(PWM_BRIGHTNESS_BREATH), or goes on when it was already
+// streaming. -1 when breath_ms is out of range or pwm_init() did not get TIM1.
+int pwm_breath_start(uint32_t breath_ms)
+{
+	if(breath_ms == 0U || breath_ms > PWM_BREATH_MAX_MS || timer_get_owner(TIMER_FOR_PWM, 0U) != TIMER_OWNER_PWM)
+	{
+		return -1;
+	}
+
+	uint32_t streaming = TIM1->DIER & TIM_DIER_UDE;
+
+	pwm_breath_setup(breath_ms);
+	TIM1->DIER |= streaming;
+	return 0;
+}
+
+// -1 when the breath is not set up. "position" is the table index the DMA
+// copies next, "streaming" is 0 while the CPU drives CCR4.
+int pwm_breath_get(uint32_t *breath_ms, uint32_t *position, uint8_t *streaming)
+{
+	if(!breath_ready)
+	{
+		return -1;
+	}
+
+	uint32_t frames_per_s = timer_clock_hz(TIMER_FOR_PWM) / ((TIM1->PSC + 1U) * (TIM1->ARR + 1U));
+
+	*breath_ms = (TIM1->RCR + 1U) * FADE_BREATH_POINTS * 1000U / frames_per_s;
+	*position = FADE_BREATH_POINTS - PWM_BREATH_DMA_CHANNEL->CNDTR;
+	*streaming = (TIM1->DIER & TIM_DIER_UDE) != 0U;
+	return 0;
+}
 
+// New prescaler and period for every running PWM timer, computed from its
+// live clock. The compare values (and staged ones) are scaled to keep their
+// duty. PSC, ARR and CCR are all preloaded and the update events are held
+// while they are written, then one forced update switches every timer at
+// once, so no period mixes old and new values. -1 and no change when freq_hz
+// is out of 1..PWM_FREQ_MAX_HZ or a timer would get fewer than min_bits bits.
+int pwm_set_frequency(uint32_t freq_hz, uint8_t min_bits)
+{
+	uint32_t psc[PWM_TIMERS], period[PWM_TIMERS];
 
+	if(freq_hz == 0U || freq_hz > PWM_FREQ_MAX_HZ || min_bits > 16U)
+	{
+		return -1;
+	}
+	for(uint32_t t = 0; t < PWM_TIMERS; t++)
+	{
+		period[t] = pwm_timing(timer_clock_hz(pwm_timers[t].timer), freq_hz, &psc[t]);
+		if(period[t] == 0U || pwm_bits(period[t]) < min_bits)
+		{
+			LOG_WARN(PWM, "%u Hz gives %u counts on %s, %u bits asked\n\r", freq_hz, period[t],
+					timer_name(pwm_timers[t].timer), min_bits);
+			return -1;
+		}
+	}
+	pwm_freq_hz = freq_hz;
 
+	uint32_t streaming = TIM1->DIER & TIM_DIER_UDE;
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
 
+	pwm_stop_breath_requests(); // Its table is for the old period
+	for(uint32_t t = 0; t < PWM_TIMERS; t++)
+	{
+		pwm_timers[t].tim->CR1 |= TIM_CR1_UDIS;
+	}
+	for(uint32_t t = 0; t < PWM_TIMERS; t++)
+	{
+		TIM_TypeDef *tim = pwm_timers[t].tim;
+		uint32_t old = tim->ARR + 1U;
 
+		if((tim->CR1 & TIM_CR1_CEN) == 0U)
+		{
+			continue; // Gets the new timing when a channel starts it
+		}
+		tim->PSC = psc[t];
+		tim->ARR = period[t] - 1U;
+		for(uint32_t ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+		{
+			if(channels[ch].tim == tim)
+			{
+				// Both factors are at most 65536, the product fits
+				*channels[ch].ccr = *channels[ch].ccr * period[t] / old;
+				staged[ch] = (uint16_t)(staged[ch] * period[t] / old);
+			}
+		}
+	}
+	pwm_release_updates();
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
 
+	// Outside the critical section, rescaling the table takes a while. CCR4
+	// holds its rescaled value meanwhile.
+	if(breath_ready)
+	{
+		pwm_breath_setup(breath_length_ms);
+		TIM1->DIER |= streaming;
+	}
+	return 0;
+}
 
+// What the blue channel's timer achieves: frequency in mHz, period in counts
+// and whole bits. Returns the frequency asked for.
+uint32_t pwm_get_frequency(uint32_t *freq_mhz, uint32_t *counts, uint8_t *bits)
+{
+	uint32_t period = TIM1->ARR + 1U;
+	uint64_t divider = (uint64_t)(TIM1->PSC + 1U) * period;
 
+	*freq_mhz = (uint32_t)(((uint64_t)timer_clock_hz(TIMER_FOR_PWM) * 1000U + divider / 2U) / divider);
+	*counts = period;
+	*bits = pwm_bits(period);
+	return pwm_freq_hz;
+}
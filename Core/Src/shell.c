@@ -0,0 +1,962 @@
+// UART command shell. USART2 RX runs on circular DMA (DMA1 channel 2) and
+// the idle-line interrupt reports new data, so there is no per-byte IRQ.
+// With CONSOLE_BACKEND_FIFO the RX FIFO interrupt feeds the shell instead.
+
+#include <string.h>
+
+#include "shell.h"
+#include "console.h"
+#include "uart_fifo.h"
+#include "log.h"
+#include "telemetry.h"
+#include "led_sched.h"
+#include "led_arb.h"
+#include "patterns.h"
+#include "player.h"
+#include "waveform.h"
+#include "timestamp.h"
+#include "timer_alloc.h"
+#include "pwm.h"
+#include "fade.h"
+#include "clock.h"
+#include "button.h"
+#include "latency.h"
+#include "fmt.h"
+#include "queue.h"
+#include "stream_buffer.h"
+
+#define SHELL_MAX_ARGS  4U
+#define SHELL_MAX_TASKS 12U
+#define SHELL_VMBENCH_RUNS 100U
+#define SHELL_TICKTEST_MS  2000U
+#define SHELL_FADEBENCH_STEPS 100U
+#define SHELL_CLOCK_BENCH_US  100000U // Window of each clock benchmark loop, ops/s = ops * 10
+#define SHELL_LATENCY_BENCH_SAMPLES 32U
+
+typedef struct
+{
+	const char *name;
+	const char *usage;
+	void (*handler)(int argc, char *argv[]);
+} shell_command;
+
+extern UART_HandleTypeDef huart2;
+extern uint32_t BlueTaskProfiler, RedTaskProfiler, GreenTaskProfiler;
+extern fade BlueFade;
+
+ShellProfiler ShellStats;
+
+static uint8_t rx_dma_buf[SHELL_RX_DMA_SIZE];
+static uint16_t rx_read_pos; // Next DMA buffer index not yet forwarded to the task
+static StreamBufferHandle_t xShellRxStream;
+
+static void cmd_help(int argc, char *argv[]);
+static void cmd_pattern(int argc, char *argv[]);
+static void cmd_period(int argc, char *argv[]);
+static void cmd_player(int argc, char *argv[]);
+static void cmd_stats(int argc, char *argv[]);
+static void cmd_tasks(int argc, char *argv[]);
+static void cmd_log(int argc, char *argv[]);
+static void cmd_telemetry(int argc, char *argv[]);
+static void cmd_vmbench(int argc, char *argv[]);
+static void cmd_timers(int argc, char *argv[]);
+static void cmd_ticktest(int argc, char *argv[]);
+static void cmd_fade(int argc, char *argv[]);
+static void cmd_breath(int argc, char *argv[]);
+static void cmd_rgb(int argc, char *argv[]);
+static void cmd_bright(int argc, char *argv[]);
+static void cmd_pwm(int argc, char *argv[]);
+static void cmd_clock(int argc, char *argv[]);
+static void cmd_latency(int argc, char *argv[]);
+
+static const shell_command commands[] =
+{
+	{ "help",    "help",                        cmd_help    },
+	{ "pattern", "pattern <id> [<priority>]",   cmd_pattern },
+	{ "period",  "period [<led> <ms> [<duty %>]]", cmd_period },
+	{ "player",  "player [latest|queue|priority]", cmd_player },
+	{ "stats",   "stats",                       cmd_stats   },
+	{ "tasks",   "tasks",                       cmd_tasks   },
+	{ "log",     "log [<module|all> <level>]",  cmd_log     },
+	{ "telemetry", "telemetry [<0..100 Hz>]",   cmd_telemetry },
+	{ "vmbench", "vmbench",                     cmd_vmbench },
+	{ "timers",  "timers",                      cmd_timers  },
+	{ "ticktest", "ticktest [<ms>]",            cmd_ticktest },
+	{ "fade",    "fade [<ms> [linear|ease|sine]]", cmd_fade    },
+	{ "breath",  "breath [<ms>]",               cmd_breath  },
+	{ "rgb",     "rgb [<hue> [<sat> [<val>]]|off]", cmd_rgb   },
+	{ "bright",  "bright <led> <0..999>|off",   cmd_bright  },
+	{ "pwm",     "pwm [<Hz> [<min bits>]]",     cmd_pwm     },
+	{ "clock",   "clock [hsi16|pll64|lprun|bench]", cmd_clock },
+	{ "latency", "latency [reset|bench]",       cmd_latency },
+};
+
+static void shell_start_rx(void)
+{
+	rx_read_pos = 0;
+	if(HAL_UARTEx_ReceiveToIdle_DMA(&huart2, rx_dma_buf, SHELL_RX_DMA_SIZE) != HAL_OK)
+	{
+		ShellStats.rx_errors++;
+	}
+}
+
+void shell_init(void)
+{
+	xShellRxStream = xStreamBufferCreate(SHELL_RX_STREAM_SIZE, 1);
+#if CONSOLE_BACKEND == CONSOLE_BACKEND_FIFO
+	uart_fifo_start_rx();
+#else
+	shell_start_rx();
+#endif
+}
+
+void shell_rx_from_isr(const uint8_t *data, uint16_t len, BaseType_t *pxHigherPriorityTaskWoken)
+{
+	size_t sent = xStreamBufferSendFromISR(xShellRxStream, data, len, pxHigherPriorityTaskWoken);
+
+	ShellStats.rx_bytes += len;
+	ShellStats.rx_dropped += len - sent;
+}
+
+// Size is the DMA write position: called on idle line, half and full buffer
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+	if(huart->Instance != USART2)
+	{
+		return;
+	}
+
+	ShellStats.rx_events++;
+
+	if(Size != rx_read_pos)
+	{
+		if(Size > rx_read_pos)
+		{
+			shell_rx_from_isr(&rx_dma_buf[rx_read_pos], Size - rx_read_pos, &xHigherPriorityTaskWoken);
+		}
+		else
+		{
+			// The DMA wrapped around since the last event
+			shell_rx_from_isr(&rx_dma_buf[rx_read_pos], SHELL_RX_DMA_SIZE - rx_read_pos, &xHigherPriorityTaskWoken);
+			shell_rx_from_isr(&rx_dma_buf[0], Size, &xHigherPriorityTaskWoken);
+		}
+		rx_read_pos = (Size == SHELL_RX_DMA_SIZE) ? 0U : Size;
+	}
+
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if(huart->Instance != USART2)
+	{
+		return;
+	}
+
+	// Overrun, framing or noise error aborts the DMA reception, start it again
+	ShellStats.rx_errors++;
+	if(huart->RxState == HAL_UART_STATE_READY)
+	{
+		shell_start_rx();
+	}
+}
+
+static int shell_parse_u32(const char *text, uint32_t *value)
+{
+	char *end;
+
+	*value = strtoul(text, &end, 0);
+	return (*text != '\0' && *end == '\0');
+}
+
+static void cmd_help(int argc, char *argv[])
+{
+	for(uint32_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+	{
+		printf("  %s\r\n", commands[i].usage);
+	}
+}
+
+static void cmd_pattern(int argc, char *argv[])
+{
+	uint32_t id, priority = 0;
+
+	if((argc != 2 && argc != 3) || !shell_parse_u32(argv[1], &id) || id > 0xFFU
+			|| (argc == 3 && (!shell_parse_u32(argv[2], &priority) || priority > 0xFFU)))
+	{
+		printf("usage: pattern <id> [<0..255 priority>]\r\n");
+		return;
+	}
+
+	if(player_request((uint8_t)id, (uint8_t)priority, timestamp_now()) != 0)
+	{
+		printf("pattern %lu dropped\r\n", id);
+		return;
+	}
+	printf("pattern %lu requested\r\n", id);
+}
+
+static void cmd_period(int argc, char *argv[])
+{
+	uint32_t ms, duty, runs;
+	uint8_t cur_duty;
+	int channel = -1;
+
+	if(argc == 3 || argc == 4)
+	{
+		channel = led_sched_find(argv[1]);
+	}
+
+	if(channel >= 0)
+	{
+		led_sched_get((uint8_t)channel, &ms, &cur_duty, &runs);
+		duty = cur_duty; // Kept unless given
+		if(!shell_parse_u32(argv[2], &ms) || (argc == 4 && !shell_parse_u32(argv[3], &duty))
+				|| duty > 100U || led_sched_set_timing((uint8_t)channel, ms, (uint8_t)duty) != 0)
+		{
+			channel = -1;
+		}
+	}
+
+	if(channel < 0 && argc != 1)
+	{
+		printf("usage: period [<led> <1..%u ms> [<0..100 %%>]]\r\n", LED_SCHED_MAX_PERIOD_MS);
+		return;
+	}
+
+	for(uint8_t ch = 0; ch < LED_SCHED_MAX_CHANNELS; ch++)
+	{
+		const led_sched_config *config = led_sched_get(ch, &ms, &cur_duty, &runs);
+		uint32_t overruns, skipped;
+
+		if(config != NULL && led_sched_overruns(ch, &overruns, &skipped) == 0)
+		{
+			printf("  %-8s period %5lu ms duty %3u %% phase %5u ms runs %lu overruns %lu skipped %lu\r\n",
+					config->name, ms, cur_duty, config->phase_ms, runs, overruns, skipped);
+		}
+	}
+}
+
+static void cmd_player(int argc, char *argv[])
+{
+	if(argc == 2)
+	{
+		player_policy policy = PLAYER_POLICY_COUNT;
+
+		for(uint32_t i = 0; i < PLAYER_POLICY_COUNT; i++)
+		{
+			if(strcmp(argv[1], player_policy_names[i]) == 0)
+			{
+				policy = (player_policy)i;
+			}
+		}
+		if(policy == PLAYER_POLICY_COUNT)
+		{
+			printf("usage: player [latest|queue|priority]\r\n");
+			return;
+		}
+		player_set_policy(policy);
+	}
+
+	printf("policy %s, %u queued\r\n", player_policy_names[player_get_policy()], player_queue_fill());
+	printf("requests %lu started %lu preempted %lu queued %lu dropped %lu completed %lu overruns %lu\r\n",
+			PlayerStats.requests, PlayerStats.started, PlayerStats.preempted, PlayerStats.queued,
+			PlayerStats.dropped, PlayerStats.completed, PlayerStats.overruns);
+
+	latency_summary summary;
+
+	latency_summarize(&latency_hists[LATENCY_FIRST_EDGE], &summary);
+	printf("request to first edge: last %lu us p50 %lu us max %lu us\r\n",
+			latency_hists[LATENCY_FIRST_EDGE].last_us, summary.p50_us, summary.max_us);
+}
+
+static void cmd_stats(int argc, char *argv[])
+{
+	printf("tasks: green %lu blue %lu red %lu\r\n", GreenTaskProfiler, BlueTaskProfiler, RedTaskProfiler);
+	printf("heap: free %u min %u\r\n", xPortGetFreeHeapSize(), xPortGetMinimumEverFreeHeapSize());
+	printf("console: written %lu dropped %lu (%lu frames)\r\n", ConsoleStats.bytes_written, ConsoleStats.bytes_dropped,
+			ConsoleStats.frames_dropped);
+#if CONSOLE_BACKEND == CONSOLE_BACKEND_FIFO
+	printf("uart fifo: irqs %lu tx %lu/%lu rx %lu/%lu overruns %lu cycles %lu\r\n",
+			UartFifoStats.irq_count, UartFifoStats.tx_bytes, UartFifoStats.tx_refills,
+			UartFifoStats.rx_bytes, UartFifoStats.rx_drains, UartFifoStats.rx_overruns, UartFifoStats.isr_cycles);
+#endif
+	printf("shell: rx %lu events %lu dropped %lu errors %lu lines %lu\r\n",
+			ShellStats.rx_bytes, ShellStats.rx_events, ShellStats.rx_dropped, ShellStats.rx_errors, ShellStats.lines);
+	printf("pattern vm: steps %lu cycles last %lu max %lu total %lu\r\n",
+			WaveformStats.vm_steps, WaveformStats.vm_cycles_last, WaveformStats.vm_cycles_max, WaveformStats.vm_cycles_total);
+	printf("led owners: green %s blue %s red %s, writes %lu shadowed %lu claims %lu\r\n",
+			led_arb_owner(LED_GREEN) ? "pattern" : "background",
+			led_arb_owner(LED_BLUE) ? "pattern" : "background",
+			led_arb_owner(LED_RED) ? "pattern" : "background",
+			LedArbStats.writes, LedArbStats.shadowed, LedArbStats.claims);
+	printf("button: edges %lu glitches %lu click %lu double %lu long %lu repeat %lu dropped %lu\r\n",
+			ButtonStats.edges, ButtonStats.glitches, ButtonStats.events[BUTTON_CLICK],
+			ButtonStats.events[BUTTON_DOUBLE_CLICK], ButtonStats.events[BUTTON_LONG_PRESS],
+			ButtonStats.events[BUTTON_REPEAT], ButtonStats.dropped);
+}
+
+static void cmd_tasks(int argc, char *argv[])
+{
+	static TaskStatus_t status[SHELL_MAX_TASKS]; // Too large for the shell stack
+	UBaseType_t count = uxTaskGetSystemState(status, SHELL_MAX_TASKS, NULL);
+
+	// usStackHighWaterMark is the least free stack ever seen, in words
+	printf("%-16s prio stack free\r\n", "task");
+	for(UBaseType_t i = 0; i < count; i++)
+	{
+		printf("%-16s %4lu %10u\r\n", status[i].pcTaskName, status[i].uxCurrentPriority, status[i].usStackHighWaterMark);
+	}
+}
+
+static const char *const log_level_names[LOG_LEVEL_COUNT] = { "off", "error", "warn", "info", "debug" };
+
+static void cmd_log(int argc, char *argv[])
+{
+	uint32_t level = LOG_LEVEL_COUNT;
+
+	if(argc == 3)
+	{
+		for(uint32_t i = 0; i < LOG_LEVEL_COUNT; i++)
+		{
+			if(strcmp(argv[2], log_level_names[i]) == 0)
+			{
+				level = i;
+			}
+		}
+	}
+
+	if(argc == 3 && level < LOG_LEVEL_COUNT)
+	{
+		uint8_t found = 0;
+
+		for(uint32_t m = 0; m < LOG_MOD_COUNT; m++)
+		{
+			if(strcmp(argv[1], "all") == 0 || strcmp(argv[1], log_module_names[m]) == 0)
+			{
+				log_threshold[m] = (uint8_t)level;
+				found = 1;
+			}
+		}
+		if(!found)
+		{
+			printf("unknown module '%s'\r\n", argv[1]);
+			return;
+		}
+	}
+	else if(argc != 1)
+	{
+		printf("usage: log [<module|all> <off|error|warn|info|debug>]\r\n");
+		return;
+	}
+
+	// Levels above the compile-time LOG_MODULE_x setting have nothing left to print
+	for(uint32_t m = 0; m < LOG_MOD_COUNT; m++)
+	{
+		printf("  %-8s %s\r\n", log_module_names[m], log_level_names[log_threshold[m]]);
+	}
+}
+
+static void cmd_telemetry(int argc, char *argv[])
+{
+	uint32_t hz;
+
+	if(argc == 2)
+	{
+		if(!shell_parse_u32(argv[1], &hz) || hz > TELEMETRY_MAX_RATE_HZ)
+		{
+			printf("usage: telemetry [<0..%u Hz>]\r\n", TELEMETRY_MAX_RATE_HZ);
+			return;
+		}
+		telemetry_set_rate(hz);
+	}
+
+	printf("telemetry %lu Hz, records %lu dropped %lu, encode last %lu us max %lu us total %lu us\r\n",
+			telemetry_get_rate(), TelemetryStats.records, TelemetryStats.dropped,
+			TelemetryStats.encode_last, TelemetryStats.encode_max, TelemetryStats.encode_total);
+}
+
+// Outputs for cmd_vmbench, discarded so only the interpreter is timed
+static void shell_vm_frame(uint16_t set_mask, uint16_t clear_mask)
+{
+}
+
+static void shell_vm_pwm(uint16_t level)
+{
+}
+
+// Runs every built-in pattern without outputs or holds, so only the
+// interpreter is timed. Preemption by other tasks is included.
+static void cmd_vmbench(int argc, char *argv[])
+{
+	static const pattern_vm_io io = { shell_vm_frame, shell_vm_pwm };
+	static pattern_vm vm;
+
+	for(uint8_t id = 0; id < pattern_count(); id++)
+	{
+		uint16_t length;
+		const uint8_t *code = pattern_get(id, &length);
+		uint32_t steps = 0;
+
+		if(code == NULL || pattern_vm_check(code, length) < 0)
+		{
+			continue;
+		}
+
+		uint32_t start = timestamp_now();
+
+		for(uint32_t run = 0; run < SHELL_VMBENCH_RUNS; run++)
+		{
+			pattern_vm_init(&vm, code, length, &io);
+			while(pattern_vm_run(&vm) > 0)
+			{
+				steps++;
+			}
+		}
+
+		uint32_t elapsed = timestamp_now() - start;
+		printf("  pattern %u: %u bytes, %lu steps, %lu ns/step\r\n",
+				id, length, steps / SHELL_VMBENCH_RUNS, (steps != 0U) ? (elapsed * 1000U) / steps : 0U);
+	}
+}
+
+static void cmd_timers(int argc, char *argv[])
+{
+	static const char *const part_names[TIMER_PARTS] = { "base", "ch1", "ch2", "ch3", "ch4" };
+
+	for(uint8_t timer = 0; timer < TIMER_COUNT; timer++)
+	{
+		printf("  %-5s %2lu MHz", timer_name(timer), timer_clock_hz(timer) / 1000000U);
+		for(uint8_t part = 0; part < TIMER_PARTS; part++)
+		{
+			timer_owner owner = timer_get_owner(timer, part);
+
+			if(owner != TIMER_OWNER_NONE)
+			{
+				printf(" %s:%s", part_names[part], timer_owner_names[owner]);
+			}
+		}
+		printf("\r\n");
+	}
+	printf("claims %lu conflicts %lu", TimerAllocStats.claims, TimerAllocStats.conflicts);
+	if(TimerAllocStats.conflicts != 0U)
+	{
+		printf(", last %s wanted by %s, held by %s", timer_name(TimerAllocStats.conflict_timer),
+				timer_owner_names[TimerAllocStats.conflict_owner], timer_owner_names[TimerAllocStats.conflict_holder]);
+	}
+	printf("\r\n");
+}
+
+// Both tick counts against TIM2 in one critical section
+static void shell_tick_sample(uint32_t *us, uint32_t *hal, TickType_t *kernel)
+{
+	taskENTER_CRITICAL();
+	*us = timestamp_now();
+	*hal = HAL_GetTick();
+	*kernel = xTaskGetTickCount();
+	taskEXIT_CRITICAL();
+}
+
+// Runs the HAL and kernel ticks against the TIM2 microsecond counter while
+// the TIM1 time base is reprogrammed every millisecond (PSC, ARR and an
+// update event, as pwm_init() does it). The channels, the blue breathing DMA
+// and the PWM driver state are left alone. With the HAL timebase on TIM1 this
+// read 5x slow; it passes when both ticks are within one tick plus 100 ppm.
+// All three count the same oscillator, so this checks the tick sources, not
+// the HSI accuracy.
+static void cmd_ticktest(int argc, char *argv[])
+{
+	uint32_t ms = SHELL_TICKTEST_MS, us0, us1, hal0, hal1;
+	uint32_t psc = TIM1->PSC, arr = TIM1->ARR, urs = TIM1->CR1 & TIM_CR1_URS;
+	TickType_t kernel0, kernel1;
+
+	if(argc > 2 || (argc == 2 && (!shell_parse_u32(argv[1], &ms) || ms == 0U || ms > 60000U)))
+	{
+		printf("usage: ticktest [<1..60000 ms>]\r\n");
+		return;
+	}
+
+	// URS: the forced update must not raise a DMA request for the breathing
+	TIM1->CR1 |= TIM_CR1_URS;
+	shell_tick_sample(&us0, &hal0, &kernel0);
+	for(uint32_t i = 0; i < ms; i++)
+	{
+		TIM1->PSC = psc;
+		TIM1->ARR = arr;
+		TIM1->EGR = TIM_EGR_UG;
+		vTaskDelay(1);
+	}
+	shell_tick_sample(&us1, &hal1, &kernel1);
+	TIM1->CR1 = (TIM1->CR1 & ~TIM_CR1_URS) | urs;
+
+	uint32_t us = us1 - us0;
+	int32_t hal_error = (int32_t)((hal1 - hal0) * 1000U - us);
+	int32_t kernel_error = (int32_t)(((kernel1 - kernel0) * 1000000U) / configTICK_RATE_HZ - us);
+	int32_t limit = 1000 + (int32_t)(us / 10000U);
+
+	printf("  TIM2 %lu us, HAL tick %lu ms (%ld us), kernel tick %lu ticks (%ld us), PWM reprogrammed %lu times\r\n",
+			us, hal1 - hal0, hal_error, kernel1 - kernel0, kernel_error, ms);
+	printf("  %s\r\n", (hal_error <= limit && hal_error >= -limit && kernel_error <= limit && kernel_error >= -limit)
+			? "pass" : "FAIL");
+}
+
+// CPU cycles between two SysTick->VAL reads less than a kernel tick apart.
+// SysTick counts down and reloads once per kernel tick.
+static uint32_t shell_cycles(uint32_t start, uint32_t end)
+{
+	return (start >= end) ? (start - end) : (start + SysTick->LOAD + 1U - end);
+}
+
+// Sets the blue breathing (one way, in ms) and times a fade step plus the
+// gamma mapping in CPU cycles, on a copy so the LED is not disturbed
+static void cmd_fade(int argc, char *argv[])
+{
+	uint32_t ms = BlueFade.ms;
+	uint8_t curve = BlueFade.curve;
+
+	if(argc > 3 || (argc >= 2 && (!shell_parse_u32(argv[1], &ms) || ms == 0U || ms > 0xFFFFU)))
+	{
+		printf("usage: fade [<1..65535 ms> [linear|ease|sine]]\r\n");
+		return;
+	}
+	if(argc == 3)
+	{
+		curve = 0;
+		while(curve < FADE_CURVE_COUNT && strcmp(argv[2], fade_curve_names[curve]) != 0)
+		{
+			curve++;
+		}
+		if(curve == FADE_CURVE_COUNT)
+		{
+			printf("usage: fade [<1..65535 ms> [linear|ease|sine]]\r\n");
+			return;
+		}
+	}
+	if(argc >= 2)
+	{
+#if PWM_BREATH_DMA
+		printf("blue breathes by DMA, see \"breath\"\r\n");
+#else
+		vTaskSuspendAll(); // The timer task steps it
+		fade_start(&BlueFade, 0, FADE_LEVEL_MAX, (uint16_t)ms, (fade_curve)curve, FADE_BOUNCE);
+		xTaskResumeAll();
+#endif
+	}
+
+	for(uint8_t c = 0; c < FADE_CURVE_COUNT; c++)
+	{
+		fade test;
+		uint32_t total = 0, max = 0;
+		volatile uint16_t duty;
+
+		fade_start(&test, 0, FADE_LEVEL_MAX, 2000, (fade_curve)c, FADE_BOUNCE);
+		for(uint32_t i = 0; i < SHELL_FADEBENCH_STEPS; i++)
+		{
+			uint32_t start = SysTick->VAL;
+
+			duty = fade_gamma_duty(fade_step(&test, 20), 16000U);
+
+			uint32_t cycles = shell_cycles(start, SysTick->VAL);
+
+			total += cycles;
+			if(cycles > max)
+			{
+				max = cycles;
+			}
+		}
+		(void)duty;
+		printf("  %-6s step + gamma: avg %lu max %lu cycles\r\n", fade_curve_names[c], total / SHELL_FADEBENCH_STEPS, max);
+	}
+#if !PWM_BREATH_DMA
+	printf("blue: %u ms each way, %s\r\n", BlueFade.ms, fade_curve_names[BlueFade.curve]);
+#endif
+}
+
+// Sets the length of one blue breath streamed by DMA and shows where it is
+static void cmd_breath(int argc, char *argv[])
+{
+	uint32_t ms, position;
+	uint8_t streaming;
+
+	if(argc > 2 || (argc == 2 && !shell_parse_u32(argv[1], &ms)))
+	{
+		printf("usage: breath [<ms>]\r\n");
+		return;
+	}
+	if(argc == 2 && pwm_breath_start(ms) != 0)
+	{
+		printf("breath: %lu ms refused (1..%u ms)\r\n", ms, PWM_BREATH_MAX_MS);
+		return;
+	}
+	if(pwm_breath_get(&ms, &position, &streaming) != 0)
+	{
+		printf("breath: not set up\r\n");
+		return;
+	}
+	printf("breath: %lu ms, %lu/%u, %s\r\n", ms, position, FADE_BREATH_POINTS,
+			streaming ? "streaming" : "CCR4 held by set_pwm_brightness()");
+}
+
+// With a hue (0..1535, red 0, green 512, blue 1024) the three LEDs show that
+// color on their PWM channels, "off" gives red and green back to the LED
+// scheduler. Without arguments times one blue update the old way against a
+// staged update of the three channels with the last color.
+static void cmd_rgb(int argc, char *argv[])
+{
+	static color_rgb color;
+	uint32_t hue, saturation = 255, value = 255;
+
+	if(argc == 2 && strcmp(argv[1], "off") == 0)
+	{
+		pwm_channel_disable(PWM_RED);
+		pwm_channel_disable(PWM_GREEN);
+		led_arb_refresh(LED_MASK_BLUE);
+		return;
+	}
+	if(argc > 4 || (argc >= 2 && (!shell_parse_u32(argv[1], &hue) || hue >= COLOR_HUE_MAX))
+			|| (argc >= 3 && (!shell_parse_u32(argv[2], &saturation) || saturation > 255U))
+			|| (argc == 4 && (!shell_parse_u32(argv[3], &value) || value > 255U)))
+	{
+		printf("usage: rgb [<hue 0..%u> [<sat 0..255> [<val 0..255>]]|off]\r\n", COLOR_HUE_MAX - 1U);
+		return;
+	}
+	if(argc >= 2)
+	{
+		color = color_hsv((uint16_t)hue, (uint8_t)saturation, (uint8_t)value);
+		if(pwm_channel_enable(PWM_RED) != 0 || pwm_channel_enable(PWM_GREEN) != 0)
+		{
+			printf("rgb: PWM timers not available, see \"timers\"\r\n");
+			return;
+		}
+		pwm_set_rgb(color);
+		printf("rgb: red %u green %u blue %u\r\n", color.red, color.green, color.blue);
+		return;
+	}
+
+	uint32_t duty_cycles, rgb_cycles, hsv_cycles, start;
+	color_rgb converted;
+
+	start = SysTick->VAL;
+	set_pwm_duty_cycle(50);
+	duty_cycles = shell_cycles(start, SysTick->VAL);
+
+	start = SysTick->VAL;
+	pwm_set_rgb(color);
+	rgb_cycles = shell_cycles(start, SysTick->VAL);
+
+	start = SysTick->VAL;
+	converted = color_hsv(700, 200, 255);
+	hsv_cycles = shell_cycles(start, SysTick->VAL);
+
+	led_arb_refresh(LED_MASK_BLUE); // Blue back to its owner, the breath goes on
+	printf("set_pwm_duty_cycle, blue only: %lu cycles\r\n", duty_cycles);
+	printf("pwm_set_rgb, 3 channels + commit: %lu cycles\r\n", rgb_cycles);
+	printf("color_hsv: %lu cycles (%u %u %u)\r\n", hsv_cycles, converted.red, converted.green, converted.blue);
+}
+
+// Dims an LED of the background layer, 0..999 as for set_pwm_brightness():
+// blue on its PWM channel, green and red by bit-angle modulation. "off" shows
+// the LED scheduler's on/off state again.
+static void cmd_bright(int argc, char *argv[])
+{
+	uint32_t level = LED_ARB_SWITCHED;
+	uint32_t led = LED_COUNT;
+
+	for(uint32_t i = 0; argc == 3 && i < LED_COUNT; i++)
+	{
+		if(strcmp(argv[1], led_names[i]) == 0)
+		{
+			led = i;
+		}
+	}
+	if(led == LED_COUNT || (strcmp(argv[2], "off") != 0 && (!shell_parse_u32(argv[2], &level) || level > 999U)))
+	{
+		printf("usage: bright <green|blue|red> <0..999>|off\r\n");
+		return;
+	}
+	led_arb_brightness(LED_LAYER_BACKGROUND, (led_id)led, (uint16_t)level);
+}
+
+// Sets the PWM frequency of the LED timers and shows what TIM1 achieves
+static void cmd_pwm(int argc, char *argv[])
+{
+	uint32_t hz, min_bits = 0, freq_mhz, counts;
+	uint8_t bits;
+
+	if(argc > 3 || (argc >= 2 && (!shell_parse_u32(argv[1], &hz) || hz == 0U || hz > PWM_FREQ_MAX_HZ))
+			|| (argc == 3 && (!shell_parse_u32(argv[2], &min_bits) || min_bits > 16U)))
+	{
+		printf("usage: pwm [<1..%u Hz> [<0..16 bits>]]\r\n", PWM_FREQ_MAX_HZ);
+		return;
+	}
+	if(argc >= 2 && pwm_set_frequency(hz, (uint8_t)min_bits) != 0)
+	{
+		printf("pwm: %lu Hz with %lu bits is out of reach at %lu Hz timer clock\r\n", hz, min_bits,
+				timer_clock_hz(TIMER_FOR_PWM));
+		return;
+	}
+
+	hz = pwm_get_frequency(&freq_mhz, &counts, &bits);
+	printf("pwm: %lu Hz asked, %lu.%03lu Hz, %lu counts (%u bits), PSC %lu\r\n", hz, freq_mhz / 1000U,
+			freq_mhz % 1000U, counts, bits, TIM1->PSC);
+}
+
+// Counts a kernel workload (queue send and receive, both through the
+// scheduler's critical sections and lists) and a formatting workload
+// (fmt_snprintf() of four conversions) over SHELL_CLOCK_BENCH_US each.
+// Other tasks preempt the loops as usual, the same way on every profile.
+static void shell_clock_bench(uint32_t *kernel_ops, uint32_t *format_ops)
+{
+	static QueueHandle_t xBenchQueue;
+	char text[48];
+	uint32_t value = 0, start;
+
+	if(xBenchQueue == NULL)
+	{
+		xBenchQueue = xQueueCreate(1, sizeof(uint32_t));
+	}
+
+	*kernel_ops = 0;
+	start = timestamp_now();
+	while(xBenchQueue != NULL && timestamp_now() - start < SHELL_CLOCK_BENCH_US)
+	{
+		xQueueSend(xBenchQueue, &value, 0);
+		xQueueReceive(xBenchQueue, &value, 0);
+		value++;
+		(*kernel_ops)++;
+	}
+
+	*format_ops = 0;
+	start = timestamp_now();
+	while(timestamp_now() - start < SHELL_CLOCK_BENCH_US)
+	{
+		fmt_snprintf(text, sizeof(text), "%u %5d %08x %s", value, -(int32_t)value, value * 2654435761U, "clock");
+		value++;
+		(*format_ops)++;
+	}
+}
+
+// Ratio to hsi16 in hundredths
+static uint32_t shell_clock_gain(uint32_t ops, uint32_t base)
+{
+	return (base != 0U) ? ops * 100U / base : 0U;
+}
+
+// Runs the benchmark on every profile, back on the starting one before
+// printing, so the output goes out at the usual speed
+static void shell_clock_compare(void)
+{
+	clock_profile original = clock_get_profile();
+	uint32_t hz[CLOCK_PROFILE_COUNT], kernel[CLOCK_PROFILE_COUNT], format[CLOCK_PROFILE_COUNT];
+
+	for(uint32_t p = 0; p < CLOCK_PROFILE_COUNT; p++)
+	{
+		hz[p] = kernel[p] = format[p] = 0;
+		if(clock_set_profile((clock_profile)p) == 0)
+		{
+			hz[p] = SystemCoreClock;
+			shell_clock_bench(&kernel[p], &format[p]);
+		}
+	}
+	clock_set_profile(original);
+
+	printf("  profile  clock   queue ops/s  gain    fmt ops/s  gain\r\n");
+	for(uint32_t p = 0; p < CLOCK_PROFILE_COUNT; p++)
+	{
+		uint32_t kernel_gain = shell_clock_gain(kernel[p], kernel[CLOCK_PROFILE_HSI16]);
+		uint32_t format_gain = shell_clock_gain(format[p], format[CLOCK_PROFILE_HSI16]);
+
+		printf("  %-7s %2lu MHz %12lu %2lu.%02lux %12lu %2lu.%02lux\r\n", clock_profile_names[p], hz[p] / 1000000U,
+				kernel[p] * (1000000U / SHELL_CLOCK_BENCH_US), kernel_gain / 100U, kernel_gain % 100U,
+				format[p] * (1000000U / SHELL_CLOCK_BENCH_US), format_gain / 100U, format_gain % 100U);
+	}
+}
+
+// Switches the system clock profile, every driver follows (clock.h)
+static void cmd_clock(int argc, char *argv[])
+{
+	uint32_t p = 0;
+
+	while(argc == 2 && p < CLOCK_PROFILE_COUNT && strcmp(argv[1], clock_profile_names[p]) != 0)
+	{
+		p++;
+	}
+	if(argc == 2 && strcmp(argv[1], "bench") == 0)
+	{
+		shell_clock_compare();
+		return;
+	}
+	if(argc > 2 || (argc == 2 && p == CLOCK_PROFILE_COUNT))
+	{
+		printf("usage: clock [hsi16|pll64|lprun|bench]\r\n");
+		return;
+	}
+	if(argc == 2 && clock_set_profile((clock_profile)p) != 0)
+	{
+		printf("clock: %s refused\r\n", argv[1]);
+	}
+
+	printf("clock: %s, %lu Hz, %lu switches (last %lu us), %lu failures\r\n", clock_profile_names[clock_get_profile()],
+			SystemCoreClock, ClockStats.switches, ClockStats.switch_us, ClockStats.failures);
+}
+
+// Cycles of one latency_push() (what latency_add() costs the ISR) and of one
+// latency_record() (the binning latency_drain() does later), into scratch
+// structures, loop included, with interrupts masked so nothing else is
+// counted
+static void shell_latency_bench(void)
+{
+	static latency_ring ring;
+	static latency_hist bench;
+	uint32_t values[SHELL_LATENCY_BENCH_SAMPLES];
+	uint32_t start, push_cycles, bin_cycles;
+	uint32_t mhz = SystemCoreClock / 1000000U;
+
+	bench.min_us = UINT32_MAX;
+	for(uint32_t i = 0; i < SHELL_LATENCY_BENCH_SAMPLES; i++)
+	{
+		values[i] = (i * 2654435761U) >> (i % 32U); // Spread over all bins
+	}
+
+	taskENTER_CRITICAL();
+	start = SysTick->VAL;
+	for(uint32_t i = 0; i < SHELL_LATENCY_BENCH_SAMPLES; i++)
+	{
+		latency_push(&ring, values[i]);
+	}
+	push_cycles = shell_cycles(start, SysTick->VAL);
+	start = SysTick->VAL;
+	for(uint32_t i = 0; i < SHELL_LATENCY_BENCH_SAMPLES; i++)
+	{
+		latency_record(&bench, values[i]);
+	}
+	bin_cycles = shell_cycles(start, SysTick->VAL);
+	taskEXIT_CRITICAL();
+
+	printf("latency_add: %lu cycles per sample, %lu ns at %lu MHz\r\n", push_cycles / SHELL_LATENCY_BENCH_SAMPLES,
+			push_cycles * 1000U / SHELL_LATENCY_BENCH_SAMPLES / mhz, mhz);
+	printf("binning in latency_drain: %lu cycles per sample\r\n", bin_cycles / SHELL_LATENCY_BENCH_SAMPLES);
+}
+
+// Button-to-LED latency per stage (latency.h), in us
+static void cmd_latency(int argc, char *argv[])
+{
+	if(argc == 2 && strcmp(argv[1], "reset") == 0)
+	{
+		latency_reset();
+		return;
+	}
+	if(argc == 2 && strcmp(argv[1], "bench") == 0)
+	{
+		shell_latency_bench();
+		return;
+	}
+	if(argc > 1)
+	{
+		printf("usage: latency [reset|bench]\r\n");
+		return;
+	}
+
+	printf("  stage         count      min      p50      p99      max  dropped\r\n");
+	for(uint32_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+	{
+		latency_summary summary;
+
+		latency_summarize(&latency_hists[stage], &summary);
+		printf("  %-10s %8lu %8lu %8lu %8lu %8lu %8lu\r\n", latency_stage_names[stage], summary.count,
+				summary.min_us, summary.p50_us, summary.p99_us, summary.max_us, summary.dropped);
+	}
+}
+
+static void shell_execute(char *line)
+{
+	char *argv[SHELL_MAX_ARGS];
+	int argc = 0;
+	char *token = strtok(line, " \t");
+
+	while(token != NULL && argc < (int)SHELL_MAX_ARGS)
+	{
+		argv[argc++] = token;
+		token = strtok(NULL, " \t");
+	}
+
+	if(argc == 0)
+	{
+		return;
+	}
+
+	for(uint32_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+	{
+		if(strcmp(argv[0], commands[i].name) == 0)
+		{
+			commands[i].handler(argc, argv);
+			return;
+		}
+	}
+	printf("unknown command '%s', try help\r\n", argv[0]);
+}
+
+void vShellTask(void *pvParameters)
+{
+	static char line[SHELL_LINE_SIZE];
+	uint8_t chunk[16];
+	uint16_t len = 0;
+	uint8_t overlong = 0;
+
+	printf("\r\n> ");
+
+	while(1)
+	{
+		size_t count = xStreamBufferReceive(xShellRxStream, chunk, sizeof(chunk), portMAX_DELAY);
+
+#if SHELL_ECHO
+		console_write(chunk, (uint16_t)count);
+#endif
+
+		for(size_t i = 0; i < count; i++)
+		{
+			char c = (char)chunk[i];
+
+			if(c == '\r' || c == '\n')
+			{
+				if(len == 0U && !overlong)
+				{
+					continue; // Second half of a CR LF pair or an empty line
+				}
+
+				ShellStats.lines++;
+				if(overlong)
+				{
+					ShellStats.overlong++;
+					printf("\r\nline too long\r\n");
+				}
+				else
+				{
+					line[len] = '\0';
+					printf("\r\n");
+					shell_execute(line);
+				}
+				printf("> ");
+				len = 0;
+				overlong = 0;
+			}
+			else if(c == '\b' || c == 0x7F)
+			{
+				if(len > 0U)
+				{
+					len--;
+				}
+			}
+			else if(len < SHELL_LINE_SIZE - 1U)
+			{
+				line[len++] = c;
+			}
+			else
+			{
+				overlong = 1;
+			}
+		}
+	}
+}
@@ -20,17 +20,20 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32g0xx_hal.h"
 #include "stm32g0xx_hal_tim.h"
+#include "timer_alloc.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-TIM_HandleTypeDef        htim1;
+TIM_HandleTypeDef        htim17;
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
 /**
-  * @brief  This function configures the TIM1 as a time base source.
+  * @brief  This function configures the TIM17 as a time base source.
+  *         TIM1 is left to the blue LED PWM (PC11 only has TIM1_CH4), see
+  *         timer_alloc.h.
   *         The time source is configured  to have 1ms time base with a dedicated
   *         Tick interrupt priority.
   * @note   This function is called  automatically at the beginning of program after
@@ -40,64 +43,53 @@ TIM_HandleTypeDef        htim1;
   */
 HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
 {
-  RCC_ClkInitTypeDef    clkconfig;
-  uint32_t              uwTimclock, uwAPB1Prescaler;
+  uint32_t              uwTimclock;
   uint32_t              uwPrescalerValue;
-  uint32_t              pFLatency;
 
   HAL_StatusTypeDef     status = HAL_OK;
 
-  /* Enable TIM1 clock */
-  __HAL_RCC_TIM1_CLK_ENABLE();
-
-/* Get clock configuration */
-  HAL_RCC_GetClockConfig(&clkconfig, &pFLatency);
-
-  /* Get APB1 prescaler */
-  uwAPB1Prescaler = clkconfig.APB1CLKDivider;
-  /* Compute TIM1 clock */
-  if (uwAPB1Prescaler == RCC_HCLK_DIV1)
+  /* Claim TIM17 and enable its clock, fails when another driver owns it */
+  if (timer_claim(TIMER_FOR_HAL_TICK, TIMER_PART_BASE, TIMER_OWNER_HAL_TICK) != 0)
   {
-    uwTimclock = HAL_RCC_GetPCLK1Freq();
-  }
-  else
-  {
-    uwTimclock = 2UL * HAL_RCC_GetPCLK1Freq();
+    return HAL_ERROR;
   }
 
-  /* Compute the prescaler value to have TIM1 counter clock equal to 1MHz */
+  /* Compute TIM17 clock */
+  uwTimclock = timer_clock_hz(TIMER_FOR_HAL_TICK);
+
+  /* Compute the prescaler value to have TIM17 counter clock equal to 1MHz */
   uwPrescalerValue = (uint32_t) ((uwTimclock / 1000000U) - 1U);
 
-  /* Initialize TIM1 */
-  htim1.Instance = TIM1;
+  /* Initialize TIM17 */
+  htim17.Instance = TIM17;
 
   /* Initialize TIMx peripheral as follow:
 
-  + Period = [(TIM1CLK/1000) - 1]. to have a (1/1000) s time base.
+  + Period = [(TIM17CLK/1000) - 1]. to have a (1/1000) s time base.
   + Prescaler = (uwTimclock/1000000 - 1) to have a 1MHz counter clock.
   + ClockDivision = 0
   + Counter direction = Up
   */
-  htim1.Init.Period = (1000000U / 1000U) - 1U;
-  htim1.Init.Prescaler = uwPrescalerValue;
-  htim1.Init.ClockDivision = 0;
-  htim1.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim1.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  htim17.Init.Period = (1000000U / 1000U) - 1U;
+  htim17.Init.Prescaler = uwPrescalerValue;
+  htim17.Init.ClockDivision = 0;
+  htim17.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim17.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
 
-  status = HAL_TIM_Base_Init(&htim1);
+  status = HAL_TIM_Base_Init(&htim17);
   if (status == HAL_OK)
   {
     /* Start the TIM time Base generation in interrupt mode */
-    status = HAL_TIM_Base_Start_IT(&htim1);
+    status = HAL_TIM_Base_Start_IT(&htim17);
     if (status == HAL_OK)
     {
-    /* Enable the TIM1 global Interrupt */
-        HAL_NVIC_EnableIRQ(TIM1_BRK_UP_TRG_COM_IRQn);
+    /* Enable the TIM17 global Interrupt */
+        HAL_NVIC_EnableIRQ(TIM17_IRQn);
       /* Configure the SysTick IRQ priority */
       if (TickPriority < (1UL << __NVIC_PRIO_BITS))
       {
         /* Configure the TIM IRQ priority */
-        HAL_NVIC_SetPriority(TIM1_BRK_UP_TRG_COM_IRQn, TickPriority, 0U);
+        HAL_NVIC_SetPriority(TIM17_IRQn, TickPriority, 0U);
         uwTickPrio = TickPriority;
       }
       else
@@ -113,25 +105,25 @@ HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
 
 /**
   * @brief  Suspend Tick increment.
-  * @note   Disable the tick increment by disabling TIM1 update interrupt.
+  * @note   Disable the tick increment by disabling TIM17 update interrupt.
   * @param  None
   * @retval None
   */
 void HAL_SuspendTick(void)
 {
-  /* Disable TIM1 update Interrupt */
-  __HAL_TIM_DISABLE_IT(&htim1, TIM_IT_UPDATE);
+  /* Disable TIM17 update Interrupt */
+  __HAL_TIM_DISABLE_IT(&htim17, TIM_IT_UPDATE);
 }
 
 /**
   * @brief  Resume Tick increment.
-  * @note   Enable the tick increment by Enabling TIM1 update interrupt.
+  * @note   Enable the tick increment by Enabling TIM17 update interrupt.
   * @param  None
   * @retval None
   */
 void HAL_ResumeTick(void)
 {
-  /* Enable TIM1 Update interrupt */
-  __HAL_TIM_ENABLE_IT(&htim1, TIM_IT_UPDATE);
+  /* Enable TIM17 Update interrupt */
+  __HAL_TIM_ENABLE_IT(&htim17, TIM_IT_UPDATE);
 }
 
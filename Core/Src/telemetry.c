@@ -0,0 +1,254 @@
+// Telemetry task: samples registered variables and streams COBS-framed,
+// CRC-protected records over the console (see telemetry.h for the format).
+
+#include "telemetry.h"
+#include "console.h"
+#include "timestamp.h"
+
+#define TELEMETRY_RECORD_MAX (1U + 2U + 4U + 192U + 4U) // Type, seq, timestamp, body, CRC
+#define TELEMETRY_FRAME_MAX  (TELEMETRY_RECORD_MAX + (TELEMETRY_RECORD_MAX / 254U) + 3U)
+
+typedef struct
+{
+	const char *name;
+	telemetry_reader read;
+	const void *arg;
+	uint8_t flags;
+	uint32_t cached; // Last value of a TELEMETRY_SLOW variable
+} telemetry_var;
+
+TelemetryProfiler TelemetryStats;
+
+static telemetry_var vars[TELEMETRY_MAX_VARS];
+static uint8_t var_count;
+static volatile uint32_t telemetry_rate;
+static TaskHandle_t xTelemetryTaskHandle;
+static uint16_t telemetry_seq;
+
+void telemetry_init(void)
+{
+	RCC->AHBENR |= RCC_AHBENR_CRCEN;
+
+	// CRC-32 as used by zlib: default polynomial and init, bit-reversed in and out
+	CRC->POL = 0x04C11DB7U;
+	CRC->INIT = 0xFFFFFFFFU;
+	CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT | CRC_CR_RESET;
+}
+
+int telemetry_register(const char *name, telemetry_reader read, const void *arg, uint8_t flags)
+{
+	if(var_count >= TELEMETRY_MAX_VARS)
+	{
+		return -1;
+	}
+
+	vars[var_count].name = name;
+	vars[var_count].read = read;
+	vars[var_count].arg = arg;
+	vars[var_count].flags = flags;
+	vars[var_count].cached = 0;
+	var_count++;
+	return 0;
+}
+
+static uint32_t telemetry_read_u32(const void *arg)
+{
+	return *(const volatile uint32_t *)arg;
+}
+
+int telemetry_register_u32(const char *name, const volatile uint32_t *value)
+{
+	return telemetry_register(name, telemetry_read_u32, (const void *)value, 0);
+}
+
+uint32_t telemetry_read_heap_free(const void *arg)
+{
+	(void)arg;
+	return xPortGetFreeHeapSize();
+}
+
+uint32_t telemetry_read_queue_fill(const void *arg)
+{
+	return uxQueueMessagesWaiting((QueueHandle_t)arg);
+}
+
+// Scans the stack for the fill pattern, register it with TELEMETRY_SLOW
+uint32_t telemetry_read_stack_free(const void *arg)
+{
+	return uxTaskGetStackHighWaterMark((TaskHandle_t)arg);
+}
+
+void telemetry_set_rate(uint32_t hz)
+{
+	if(hz > TELEMETRY_MAX_RATE_HZ)
+	{
+		hz = TELEMETRY_MAX_RATE_HZ;
+	}
+	telemetry_rate = hz;
+
+	if(xTelemetryTaskHandle != NULL)
+	{
+		xTaskNotifyGive(xTelemetryTaskHandle); // Leave the idle wait when streaming starts
+	}
+}
+
+uint32_t telemetry_get_rate(void)
+{
+	return telemetry_rate;
+}
+
+static uint32_t telemetry_crc(const uint8_t *data, uint16_t len)
+{
+	CRC->CR |= CRC_CR_RESET;
+	for(uint16_t i = 0; i < len; i++)
+	{
+		*(volatile uint8_t *)&CRC->DR = data[i];
+	}
+	return ~CRC->DR;
+}
+
+// Replaces every zero so that 0x00 only ever marks the end of a frame
+static uint16_t telemetry_cobs(const uint8_t *src, uint16_t len, uint8_t *dst)
+{
+	uint16_t code_pos = 0;
+	uint16_t out = 1;
+	uint8_t code = 1;
+
+	for(uint16_t i = 0; i < len; i++)
+	{
+		if(src[i] == 0U)
+		{
+			dst[code_pos] = code;
+			code_pos = out++;
+			code = 1;
+		}
+		else
+		{
+			dst[out++] = src[i];
+			code++;
+			if(code == 0xFFU)
+			{
+				dst[code_pos] = code;
+				code_pos = out++;
+				code = 1;
+			}
+		}
+	}
+	dst[code_pos] = code;
+
+	return out;
+}
+
+static void put_u32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t)value;
+	dst[1] = (uint8_t)(value >> 8);
+	dst[2] = (uint8_t)(value >> 16);
+	dst[3] = (uint8_t)(value >> 24);
+}
+
+static void telemetry_send(uint8_t *record, uint16_t len)
+{
+	static uint8_t frame[TELEMETRY_FRAME_MAX];
+	uint16_t size;
+
+	put_u32(&record[len], telemetry_crc(record, len));
+	len += 4U;
+
+	frame[0] = TELEMETRY_SYNC;
+	size = 1U + telemetry_cobs(record, len, &frame[1]);
+	frame[size++] = 0x00U;
+
+	// A cut frame would lose its 0x00 and merge with the next one
+	if(console_write_frame(frame, size) < 0)
+	{
+		TelemetryStats.dropped++;
+	}
+}
+
+static uint16_t telemetry_header(uint8_t *record, uint8_t type)
+{
+	record[0] = type;
+	record[1] = (uint8_t)telemetry_seq;
+	record[2] = (uint8_t)(telemetry_seq >> 8);
+	put_u32(&record[3], timestamp_now());
+	telemetry_seq++;
+	return 7U;
+}
+
+static void telemetry_send_schema(uint8_t *record)
+{
+	uint16_t len = telemetry_header(record, TELEMETRY_SCHEMA);
+
+	for(uint8_t i = 0; i < var_count; i++)
+	{
+		for(const char *c = vars[i].name; *c != '\0' && len < TELEMETRY_RECORD_MAX - 5U; c++)
+		{
+			record[len++] = (uint8_t)*c;
+		}
+		if(i + 1U < var_count && len < TELEMETRY_RECORD_MAX - 5U)
+		{
+			record[len++] = ',';
+		}
+	}
+	telemetry_send(record, len);
+}
+
+static void telemetry_send_data(uint8_t *record, uint32_t sample)
+{
+	uint32_t start = timestamp_now();
+	uint16_t len = telemetry_header(record, TELEMETRY_DATA);
+
+	for(uint8_t i = 0; i < var_count; i++)
+	{
+		telemetry_var *var = &vars[i];
+
+		if(!(var->flags & TELEMETRY_SLOW) || (sample % TELEMETRY_SLOW_DIVIDER) == 0U)
+		{
+			var->cached = var->read(var->arg);
+		}
+		put_u32(&record[len], var->cached);
+		len += 4U;
+	}
+	telemetry_send(record, len);
+
+	uint32_t elapsed = timestamp_now() - start;
+	TelemetryStats.records++;
+	TelemetryStats.encode_last = elapsed;
+	TelemetryStats.encode_total += elapsed;
+	if(elapsed > TelemetryStats.encode_max)
+	{
+		TelemetryStats.encode_max = elapsed;
+	}
+}
+
+void vTelemetryTask(void *pvParameters)
+{
+	static uint8_t record[TELEMETRY_RECORD_MAX];
+	TickType_t xLastWakeTime = xTaskGetTickCount();
+	uint32_t sample = 0;
+
+	xTelemetryTaskHandle = xTaskGetCurrentTaskHandle();
+
+	while(1)
+	{
+		uint32_t rate = telemetry_rate;
+
+		if(rate == 0U)
+		{
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			xLastWakeTime = xTaskGetTickCount();
+			sample = 0;
+			continue;
+		}
+
+		if(sample % TELEMETRY_SCHEMA_EVERY == 0U)
+		{
+			telemetry_send_schema(record);
+		}
+		telemetry_send_data(record, sample);
+		sample++;
+
+		vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(1000U / rate));
+	}
+}
@@ -0,0 +1,98 @@
+//Timer ownership and timer kernel clocks, see timer_alloc.h
+
+#include "timer_alloc.h"
+
+typedef struct
+{
+	const char *name;
+	volatile uint32_t *enable_reg; // RCC APBENRx
+	uint32_t enable_bit;
+} timer_desc;
+
+static const timer_desc timers[TIMER_COUNT] =
+{
+	[TIMER_TIM1]  = { "TIM1",  &RCC->APBENR2, RCC_APBENR2_TIM1EN  },
+	[TIMER_TIM2]  = { "TIM2",  &RCC->APBENR1, RCC_APBENR1_TIM2EN  },
+	[TIMER_TIM3]  = { "TIM3",  &RCC->APBENR1, RCC_APBENR1_TIM3EN  },
+	[TIMER_TIM6]  = { "TIM6",  &RCC->APBENR1, RCC_APBENR1_TIM6EN  },
+	[TIMER_TIM7]  = { "TIM7",  &RCC->APBENR1, RCC_APBENR1_TIM7EN  },
+	[TIMER_TIM14] = { "TIM14", &RCC->APBENR2, RCC_APBENR2_TIM14EN },
+	[TIMER_TIM15] = { "TIM15", &RCC->APBENR2, RCC_APBENR2_TIM15EN },
+	[TIMER_TIM16] = { "TIM16", &RCC->APBENR2, RCC_APBENR2_TIM16EN },
+	[TIMER_TIM17] = { "TIM17", &RCC->APBENR2, RCC_APBENR2_TIM17EN },
+};
+
+const char *const timer_owner_names[TIMER_OWNER_COUNT] =
+{
+	"-", "hal tick", "timestamp", "bam", "waveform", "pwm", "button"
+};
+
+static uint8_t owners[TIMER_COUNT][TIMER_PARTS]; // timer_owner of each part
+
+TimerAllocProfiler TimerAllocStats;
+
+// Returns 0 when every part in "parts" is free or already the owner's, -1 and
+// no change otherwise. Claiming again is allowed (HAL_InitTick() runs again
+// on every clock change). Called from init code only, before the scheduler
+// or from one task, so there is no lock.
+int timer_claim(uint8_t timer, uint8_t parts, timer_owner owner)
+{
+	if(timer >= TIMER_COUNT || owner == TIMER_OWNER_NONE || owner >= TIMER_OWNER_COUNT)
+	{
+		return -1;
+	}
+
+	for(uint32_t part = 0; part < TIMER_PARTS; part++)
+	{
+		uint8_t holder = owners[timer][part];
+
+		if((parts & (1U << part)) && holder != TIMER_OWNER_NONE && holder != owner)
+		{
+			TimerAllocStats.conflicts++;
+			TimerAllocStats.conflict_timer = timer;
+			TimerAllocStats.conflict_owner = (uint8_t)owner;
+			TimerAllocStats.conflict_holder = holder;
+			return -1;
+		}
+	}
+
+	for(uint32_t part = 0; part < TIMER_PARTS; part++)
+	{
+		if(parts & (1U << part))
+		{
+			owners[timer][part] = (uint8_t)owner;
+		}
+	}
+	*timers[timer].enable_reg |= timers[timer].enable_bit;
+	TimerAllocStats.claims++;
+	return 0;
+}
+
+timer_owner timer_get_owner(uint8_t timer, uint8_t part)
+{
+	return (timer < TIMER_COUNT && part < TIMER_PARTS) ? (timer_owner)owners[timer][part] : TIMER_OWNER_NONE;
+}
+
+const char *timer_name(uint8_t timer)
+{
+	return (timer < TIMER_COUNT) ? timers[timer].name : "?";
+}
+
+// Counter clock before the prescaler, in Hz
+uint32_t timer_clock_hz(uint8_t timer)
+{
+	uint32_t clock = HAL_RCC_GetPCLK1Freq();
+
+	if((timer == TIMER_TIM1 && (RCC->CCIPR & RCC_CCIPR_TIM1SEL) != 0U)
+			|| (timer == TIMER_TIM15 && (RCC->CCIPR & RCC_CCIPR_TIM15SEL) != 0U))
+	{
+		return HAL_RCCEx_GetPeriphCLKFreq((timer == TIMER_TIM1) ? RCC_PERIPHCLK_TIM1 : RCC_PERIPHCLK_TIM15);
+	}
+
+	// Timers run at twice PCLK when the APB prescaler is not 1
+	if((RCC->CFGR & RCC_CFGR_PPRE_2) != 0U)
+	{
+		clock *= 2U;
+	}
+	return clock;
+}
@@ -0,0 +1,45 @@
+//TIM2 - free-running 32-bit microsecond counter
+
+#include "timestamp.h"
+#include "timer_alloc.h"
+#include "clock.h"
+#include "cmsis_os.h"
+#include "log.h"
+
+// New prescaler after a clock switch. UG loads it at once but clears the
+// counter, so the count is put back: the microseconds keep going.
+static void timestamp_clock_changed(clock_event event)
+{
+	if(event != CLOCK_AFTER)
+	{
+		return;
+	}
+
+	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	uint32_t count = TIM2->CNT;
+
+	TIM2->PSC = (timer_clock_hz(TIMER_FOR_TIMESTAMP) / TIMESTAMP_HZ) - 1U;
+	TIM2->EGR = TIM_EGR_UG;
+	TIM2->CNT = count;
+	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+}
+
+void timestamp_init(void)
+{
+	if(timer_claim(TIMER_FOR_TIMESTAMP, TIMER_PART_BASE, TIMER_OWNER_TIMESTAMP) != 0)
+	{
+		LOG_ERROR(KERNEL, "TIM2 already claimed, no timestamps\n\r");
+		return;
+	}
+
+	uint32_t timer_clock = timer_clock_hz(TIMER_FOR_TIMESTAMP);
+
+	TIM2->CR1 = 0;                                   // Up-counter, no preload
+	TIM2->PSC = (timer_clock / TIMESTAMP_HZ) - 1U;   // 1 MHz counter clock
+	TIM2->ARR = 0xFFFFFFFFU;                         // Use the full 32-bit range
+	TIM2->CNT = 0;
+	TIM2->EGR |= TIM_EGR_UG;                         // Load the prescaler value
+	TIM2->CR1 |= TIM_CR1_CEN;                        // Start the timer
+
+	clock_register(timestamp_clock_changed);
+}
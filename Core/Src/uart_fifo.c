@@ -0,0 +1,103 @@
+// USART2 FIFO mode driver: one interrupt per batch of up to 8 bytes instead of
+// one per byte. MX_USART2_UART_Init() enables the FIFOs and sets the thresholds.
+
+#include "uart_fifo.h"
+#include "console.h"
+#include "shell.h"
+#include "stm32g0xx_ll_usart.h"
+
+UartFifoProfiler UartFifoStats;
+
+void uart_fifo_start_rx(void)
+{
+	LL_USART_SetRxTimeout(USART2, UART_FIFO_RX_TIMEOUT);
+	LL_USART_EnableRxTimeout(USART2);
+	LL_USART_ClearFlag_RTO(USART2);
+	LL_USART_ClearFlag_ORE(USART2);
+	LL_USART_EnableIT_RXFT(USART2);
+	LL_USART_EnableIT_RTO(USART2);
+	LL_USART_EnableIT_ERROR(USART2);
+}
+
+// Called by the console with interrupts masked whenever bytes were queued
+void uart_fifo_tx_kick(void)
+{
+	LL_USART_EnableIT_TXFT(USART2);
+}
+
+static void uart_fifo_tx(BaseType_t *pxHigherPriorityTaskWoken)
+{
+	uint8_t batch[UART_FIFO_DEPTH];
+	uint16_t len = console_tx_pop(batch, UART_FIFO_DEPTH, pxHigherPriorityTaskWoken);
+
+	if(len == 0U)
+	{
+		// Nothing left, stay quiet until the next uart_fifo_tx_kick()
+		LL_USART_DisableIT_TXFT(USART2);
+		return;
+	}
+
+	// The threshold is "FIFO empty", so all 8 slots are free
+	for(uint16_t i = 0; i < len; i++)
+	{
+		LL_USART_TransmitData8(USART2, batch[i]);
+	}
+	UartFifoStats.tx_refills++;
+	UartFifoStats.tx_bytes += len;
+}
+
+static void uart_fifo_rx(BaseType_t *pxHigherPriorityTaskWoken)
+{
+	uint8_t batch[UART_FIFO_DEPTH];
+	uint16_t len = 0;
+
+	while(len < UART_FIFO_DEPTH && LL_USART_IsActiveFlag_RXNE_RXFNE(USART2))
+	{
+		batch[len++] = LL_USART_ReceiveData8(USART2);
+	}
+
+	if(len > 0U)
+	{
+		shell_rx_from_isr(batch, len, pxHigherPriorityTaskWoken);
+	}
+	UartFifoStats.rx_drains++;
+	UartFifoStats.rx_bytes += len;
+}
+
+void uart_fifo_irq_handler(void)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	uint32_t start = SysTick->VAL;
+	uint32_t end;
+
+	UartFifoStats.irq_count++;
+
+	if(LL_USART_IsActiveFlag_ORE(USART2) || LL_USART_IsActiveFlag_FE(USART2) || LL_USART_IsActiveFlag_NE(USART2))
+	{
+		// The FIFO keeps the bytes received before the error, just drop the flags
+		if(LL_USART_IsActiveFlag_ORE(USART2))
+		{
+			UartFifoStats.rx_overruns++;
+		}
+		LL_USART_ClearFlag_ORE(USART2);
+		LL_USART_ClearFlag_FE(USART2);
+		LL_USART_ClearFlag_NE(USART2);
+	}
+
+	if(LL_USART_IsActiveFlag_RXFT(USART2) || LL_USART_IsActiveFlag_RTO(USART2))
+	{
+		LL_USART_ClearFlag_RTO(USART2);
+		uart_fifo_rx(&xHigherPriorityTaskWoken);
+	}
+
+	if(LL_USART_IsEnabledIT_TXFT(USART2) && LL_USART_IsActiveFlag_TXFT(USART2))
+	{
+		uart_fifo_tx(&xHigherPriorityTaskWoken);
+	}
+
+	// SysTick counts down and reloads once per kernel tick
+	end = SysTick->VAL;
+	UartFifoStats.isr_cycles += (start >= end) ? (start - end) : (start + SysTick->LOAD + 1U - end);
+
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
@@ -0,0 +1,167 @@
+//TIM7 - LED pattern playback, one interpreter step per update, see waveform.h
+
+#include "waveform.h"
+#include "timer_alloc.h"
+#include "clock.h"
+#include "timestamp.h"
+#include "log.h"
+
+static volatile uint8_t wave_busy;
+static TaskHandle_t wave_notify;
+static pattern_vm *wave_vm;            // Program played by waveform_run()
+static uint32_t wave_hold;             // ms of the current hold not loaded into ARR yet
+static volatile uint32_t wave_end_us;  // timestamp_now() of the last end in the interrupt
+static volatile uint8_t wave_ended;
+
+WaveformProfiler WaveformStats;
+
+#define WAVEFORM_MAX_HOLD_MS 6000U     // Fits the 16-bit ARR at WAVEFORM_TICK_US
+
+// The preloaded PSC takes over at the next hold, the hold in progress keeps the old rate
+static void waveform_clock_changed(clock_event event)
+{
+	if(event == CLOCK_AFTER)
+	{
+		TIM7->PSC = (timer_clock_hz(TIMER_FOR_WAVEFORM) / (1000000U / WAVEFORM_TICK_US)) - 1U;
+	}
+}
+
+void waveform_init(void)
+{
+	if(timer_claim(TIMER_FOR_WAVEFORM, TIMER_PART_BASE, TIMER_OWNER_WAVEFORM) != 0)
+	{
+		LOG_ERROR(PATTERN, "TIM7 already claimed, no waveform playback\n\r");
+		return;
+	}
+
+	uint32_t timer_clock = timer_clock_hz(TIMER_FOR_WAVEFORM);
+
+	TIM7->CR1 = TIM_CR1_URS;                                         // UG raises no interrupt
+	TIM7->PSC = (timer_clock / (1000000U / WAVEFORM_TICK_US)) - 1U;  // One count per tick
+	TIM7->DIER = TIM_DIER_UIE;
+
+	NVIC_SetPriority(TIM7_LPTIM2_IRQn, 1);
+	NVIC_EnableIRQ(TIM7_LPTIM2_IRQn);
+
+	clock_register(waveform_clock_changed);
+}
+
+// Loads the next part of the current hold, the counter has just restarted
+static void waveform_load_hold(void)
+{
+	uint32_t ms = (wave_hold > WAVEFORM_MAX_HOLD_MS) ? WAVEFORM_MAX_HOLD_MS : wave_hold;
+
+	wave_hold -= ms;
+	TIM7->ARR = WAVEFORM_MS(ms) - 1U;
+}
+
+// Plays a pattern program from its current position, notify (may be NULL) is
+// given when it ends. The first outputs are written before this returns.
+int waveform_run(pattern_vm *vm, TaskHandle_t notify)
+{
+	if(wave_busy)
+	{
+		return -1;
+	}
+
+	int32_t hold = pattern_vm_run(vm);
+
+	if(hold <= 0)
+	{
+		return (hold == 0) ? 1 : -1; // Nothing to time, ended or broken
+	}
+
+	wave_vm = vm;
+	wave_notify = notify;
+	wave_hold = (uint32_t)hold;
+	wave_busy = 1;
+
+	TIM7->CNT = 0;
+	waveform_load_hold();
+	TIM7->EGR = TIM_EGR_UG;
+	TIM7->CR1 |= TIM_CR1_CEN;
+
+	return 0;
+}
+
+// Safe to follow with a new waveform_run() at once: an update
+// that was pending cannot step the next pattern
+void waveform_stop(void)
+{
+	TIM7->CR1 &= ~TIM_CR1_CEN;
+	TIM7->SR = 0;
+	NVIC_ClearPendingIRQ(TIM7_LPTIM2_IRQn);
+	wave_busy = 0;
+}
+
+uint8_t waveform_busy(void)
+{
+	return wave_busy;
+}
+
+// Once per end of a pattern in the TIM7 interrupt: 1 and its time, for the
+// task it notified. Ends by waveform_stop() or at start are not counted.
+uint8_t waveform_ended(uint32_t *end_us)
+{
+	if(!wave_ended)
+	{
+		return 0;
+	}
+	*end_us = wave_end_us;
+	wave_ended = 0;
+	return 1;
+}
+
+static void waveform_end_from_isr(void)
+{
+	wave_end_us = timestamp_now();
+	wave_ended = 1;
+	TIM7->CR1 &= ~TIM_CR1_CEN;
+	wave_busy = 0;
+	if(wave_notify != NULL)
+	{
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(wave_notify, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
+}
+
+// A hold has elapsed: run the program to its next hold
+static void waveform_vm_step(void)
+{
+	uint32_t start, end;
+	int32_t hold;
+
+	if(wave_hold != 0U)
+	{
+		waveform_load_hold(); // Still inside a hold longer than ARR can count
+		return;
+	}
+
+	start = SysTick->VAL;
+	hold = pattern_vm_run(wave_vm);
+	end = SysTick->VAL;
+
+	// SysTick counts down and reloads once per kernel tick
+	WaveformStats.vm_cycles_last = (start >= end) ? (start - end) : (start + SysTick->LOAD + 1U - end);
+	WaveformStats.vm_steps++;
+	WaveformStats.vm_cycles_total += WaveformStats.vm_cycles_last;
+	if(WaveformStats.vm_cycles_last > WaveformStats.vm_cycles_max)
+	{
+		WaveformStats.vm_cycles_max = WaveformStats.vm_cycles_last;
+	}
+
+	if(hold <= 0)
+	{
+		waveform_end_from_isr();
+		return;
+	}
+	wave_hold = (uint32_t)hold;
+	waveform_load_hold();
+}
+
+void TIM7_LPTIM2_IRQHandler(void)
+{
+	TIM7->SR = 0;
+	waveform_vm_step();
+}
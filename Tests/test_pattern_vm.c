@@ -0,0 +1,258 @@
+//Host unit tests of the pattern bytecode interpreter, built by Tests/Makefile
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pattern_vm.h"
+#include "patterns.h"
+
+static int failures;
+
+#define CHECK(cond) \
+	do \
+	{ \
+		if(!(cond)) \
+		{ \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			failures++; \
+		} \
+	} while(0)
+
+#define CHECK_EQ(a, b) \
+	do \
+	{ \
+		long long a_ = (long long)(a), b_ = (long long)(b); \
+		if(a_ != b_) \
+		{ \
+			printf("%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #a, a_, b_); \
+			failures++; \
+		} \
+	} while(0)
+
+// Every output call the interpreter makes, in order
+typedef struct
+{
+	char kind; // 'f' frame, 'p' pwm
+	uint16_t a;
+	uint16_t b;
+} io_call;
+
+static io_call calls[512];
+static unsigned call_count;
+
+static void record_frame(uint16_t set_mask, uint16_t clear_mask)
+{
+	if(call_count < sizeof(calls) / sizeof(calls[0]))
+	{
+		calls[call_count++] = (io_call){ 'f', set_mask, clear_mask };
+	}
+}
+
+static void record_pwm(uint16_t level)
+{
+	if(call_count < sizeof(calls) / sizeof(calls[0]))
+	{
+		calls[call_count++] = (io_call){ 'p', level, 0 };
+	}
+}
+
+static const pattern_vm_io record_io = { record_frame, record_pwm };
+
+// Plays the code to its END and returns the sum of the holds, -1 on an error
+static int32_t play(const uint8_t *code, uint16_t length)
+{
+	pattern_vm vm;
+	int32_t total = 0;
+	int32_t hold;
+
+	call_count = 0;
+	pattern_vm_init(&vm, code, length, &record_io);
+	while((hold = pattern_vm_run(&vm)) > 0)
+	{
+		total += hold;
+	}
+	return (hold == 0) ? total : PATTERN_VM_ERROR;
+}
+
+static void test_decode(void)
+{
+	static const uint8_t code[] =
+	{
+		PATTERN_SET(0x0400), PATTERN_SET(0x1000), PATTERN_CLEAR(0x1000), PATTERN_WAIT(300),
+		PATTERN_PWM(500), PATTERN_PWMD(-100), PATTERN_WAITB(20),
+		PATTERN_PWMD(127), PATTERN_PWMD(127), PATTERN_PWMD(127), PATTERN_PWMD(127), PATTERN_PWMD(127),
+		PATTERN_WAITB(5),
+		PATTERN_CLEAR(0x0400),
+		PATTERN_END()
+	};
+
+	CHECK_EQ(pattern_vm_check(code, sizeof(code)), 325);
+	CHECK_EQ(play(code, sizeof(code)), 325);
+
+	// SET and CLEAR of one instant go out as a single frame, the later one wins
+	CHECK_EQ(calls[0].kind, 'f');
+	CHECK_EQ(calls[0].a, 0x0400);
+	CHECK_EQ(calls[0].b, 0x1000);
+	// PWMD is relative to the last level and clamped at PATTERN_VM_PWM_MAX
+	CHECK_EQ(calls[1].kind, 'p');
+	CHECK_EQ(calls[1].a, 500);
+	CHECK_EQ(calls[2].a, 400);
+	CHECK_EQ(calls[6].a, 908);
+	CHECK_EQ(calls[7].a, PATTERN_VM_PWM_MAX);
+	// The CLEAR right before END is still written
+	CHECK_EQ(calls[8].kind, 'f');
+	CHECK_EQ(calls[8].b, 0x0400);
+	CHECK_EQ(call_count, 9);
+}
+
+static void test_end_is_sticky(void)
+{
+	static const uint8_t code[] = { PATTERN_WAITB(10), PATTERN_END() };
+	pattern_vm vm;
+
+	pattern_vm_init(&vm, code, sizeof(code), &record_io);
+	CHECK_EQ(pattern_vm_run(&vm), 10);
+	CHECK_EQ(pattern_vm_run(&vm), 0);
+	CHECK_EQ(pattern_vm_run(&vm), 0);
+}
+
+static void test_ramp(void)
+{
+	// 25 ms in 10 ms steps: 10, 10, then the 5 ms remainder
+	static const uint8_t code[] = { PATTERN_RAMP(0, 999, 25), PATTERN_END() };
+	pattern_vm vm;
+
+	call_count = 0;
+	pattern_vm_init(&vm, code, sizeof(code), &record_io);
+	CHECK_EQ(pattern_vm_run(&vm), 10);
+	CHECK_EQ(pattern_vm_run(&vm), 10);
+	CHECK_EQ(pattern_vm_run(&vm), 5);
+	CHECK_EQ(pattern_vm_run(&vm), 0);
+	CHECK_EQ(calls[0].a, 0);
+	CHECK(calls[1].a > calls[0].a && calls[2].a > calls[1].a);
+	CHECK_EQ(calls[call_count - 1U].a, 999); // Exact end level
+	CHECK_EQ(pattern_vm_check(code, sizeof(code)), 25);
+}
+
+static void test_loop_nesting(void)
+{
+	static const uint8_t nested[] =
+	{
+		PATTERN_LOOP(2),
+			PATTERN_LOOP(3),
+				PATTERN_SET(0x0400), PATTERN_WAITB(10),
+				PATTERN_CLEAR(0x0400), PATTERN_WAITB(10),
+			PATTERN_NEXT(),
+			PATTERN_WAITB(5),
+		PATTERN_NEXT(),
+		PATTERN_END()
+	};
+	static const uint8_t deepest[] =
+	{
+		PATTERN_LOOP(2), PATTERN_LOOP(2), PATTERN_LOOP(2), PATTERN_LOOP(2),
+		PATTERN_WAITB(1),
+		PATTERN_NEXT(), PATTERN_NEXT(), PATTERN_NEXT(), PATTERN_NEXT(),
+		PATTERN_END()
+	};
+	static const uint8_t too_deep[] =
+	{
+		PATTERN_LOOP(2), PATTERN_LOOP(2), PATTERN_LOOP(2), PATTERN_LOOP(2), PATTERN_LOOP(2),
+		PATTERN_WAITB(1),
+		PATTERN_NEXT(), PATTERN_NEXT(), PATTERN_NEXT(), PATTERN_NEXT(), PATTERN_NEXT(),
+		PATTERN_END()
+	};
+	unsigned sets = 0;
+
+	CHECK_EQ(pattern_vm_check(nested, sizeof(nested)), 2 * (3 * 20 + 5));
+	CHECK_EQ(play(nested, sizeof(nested)), 2 * (3 * 20 + 5));
+	for(unsigned i = 0; i < call_count; i++)
+	{
+		sets += (calls[i].kind == 'f' && calls[i].a == 0x0400);
+	}
+	CHECK_EQ(sets, 6);
+
+	CHECK_EQ(PATTERN_VM_MAX_DEPTH, 4);
+	CHECK_EQ(pattern_vm_check(deepest, sizeof(deepest)), 16);
+	CHECK_EQ(play(deepest, sizeof(deepest)), 16);
+	CHECK_EQ(pattern_vm_check(too_deep, sizeof(too_deep)), PATTERN_VM_ERROR);
+}
+
+static void test_check_rejects(void)
+{
+	static const uint8_t unknown_op[]   = { 0x7F, PATTERN_END() };
+	static const uint8_t truncated[]    = { PATTERN_VM_OP_WAIT, 0x10 };
+	static const uint8_t no_end[]       = { PATTERN_WAITB(10) };
+	static const uint8_t pwm_range[]    = { PATTERN_PWM(1000), PATTERN_END() };
+	static const uint8_t ramp_range[]   = { PATTERN_RAMP(0, 1000, 100), PATTERN_END() };
+	static const uint8_t pwmd_first[]   = { PATTERN_PWMD(10), PATTERN_END() };
+	static const uint8_t loop_zero[]    = { PATTERN_LOOP(0), PATTERN_WAITB(10), PATTERN_NEXT(), PATTERN_END() };
+	static const uint8_t stray_next[]   = { PATTERN_WAITB(10), PATTERN_NEXT(), PATTERN_END() };
+	static const uint8_t open_loop[]    = { PATTERN_LOOP(2), PATTERN_WAITB(10), PATTERN_END() };
+	static const uint8_t empty_body[]   = { PATTERN_LOOP(2), PATTERN_SET(0x0400), PATTERN_NEXT(), PATTERN_END() };
+	static const uint8_t too_long[]     = { PATTERN_LOOP(255), PATTERN_LOOP(255), PATTERN_LOOP(255), PATTERN_WAIT(65535),
+			PATTERN_NEXT(), PATTERN_NEXT(), PATTERN_NEXT(), PATTERN_END() };
+
+	CHECK_EQ(pattern_vm_check(unknown_op, sizeof(unknown_op)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(truncated, sizeof(truncated)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(no_end, sizeof(no_end)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(pwm_range, sizeof(pwm_range)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(ramp_range, sizeof(ramp_range)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(pwmd_first, sizeof(pwmd_first)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(loop_zero, sizeof(loop_zero)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(stray_next, sizeof(stray_next)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(open_loop, sizeof(open_loop)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(empty_body, sizeof(empty_body)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(too_long, sizeof(too_long)), PATTERN_VM_ERROR);
+	CHECK_EQ(pattern_vm_check(unknown_op, 0), PATTERN_VM_ERROR);
+
+	// The interpreter refuses the same code on its own
+	CHECK_EQ(play(unknown_op, sizeof(unknown_op)), PATTERN_VM_ERROR);
+	CHECK_EQ(play(stray_next, sizeof(stray_next)), PATTERN_VM_ERROR);
+	CHECK_EQ(play(no_end, sizeof(no_end)), PATTERN_VM_ERROR);
+}
+
+// The shipped blob (pattern_blob.c): every pattern checks, and plays for
+// exactly the length the check reports
+static void test_blob(void)
+{
+	static const int32_t expected_ms[] = { 1800, 2400, 2000 };
+
+	CHECK(pattern_count() >= 3U);
+	for(uint8_t id = 0; id < pattern_count(); id++)
+	{
+		uint16_t length;
+		const uint8_t *code = pattern_get(id, &length);
+
+		if(code == NULL)
+		{
+			continue;
+		}
+		int32_t checked = pattern_vm_check(code, length);
+
+		CHECK(checked > 0);
+		CHECK_EQ(play(code, length), checked);
+		if(id < sizeof(expected_ms) / sizeof(expected_ms[0]))
+		{
+			CHECK_EQ(checked, expected_ms[id]);
+		}
+	}
+	CHECK(pattern_get(pattern_count(), NULL) == NULL);
+}
+
+int main(void)
+{
+	test_decode();
+	test_end_is_sticky();
+	test_ramp();
+	test_loop_nesting();
+	test_check_rejects();
+	test_blob();
+
+	if(failures != 0)
+	{
+		printf("pattern_vm: %d failures\n", failures);
+		return 1;
+	}
+	printf("pattern_vm: all tests passed\n");
+	return 0;
+}
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Report flash and RAM usage of a firmware ELF file, or compare two builds.
+
+Sections are summed the same way arm-none-eabi-size does (text = code and
+read-only data in flash, data = initialised RAM, bss = zeroed RAM). The
+non-loaded .log_fmt section is counted separately: it holds the format
+strings of every LOG() call that survived the compile-time log levels. With
+--symbols the largest functions and objects are listed, and when two ELF
+files are given every symbol whose size changed is shown.
+
+Usage:
+    elf_size.py firmware.elf [--symbols 20]
+    elf_size.py before.elf after.elf [--symbols 20]
+"""
+
+import argparse
+import struct
+import sys
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+STT_OBJECT = 1
+STT_FUNC = 2
+
+
+class Elf:
+    """Minimal ELF32 little-endian reader for section and symbol sizes."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("%s is not a 32-bit little endian ELF file" % path)
+
+        (shoff,) = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x2E)
+        self.headers = [struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize) for i in range(shnum)]
+        strtab = self.headers[shstrndx][4]
+        self.names = [self.string(strtab, h[0]) for h in self.headers]
+
+    def string(self, table, offset):
+        end = self.data.index(b"\0", table + offset)
+        return self.data[table + offset:end].decode("utf-8", "replace")
+
+    def totals(self):
+        text = data = bss = 0
+        for (_, sh_type, flags, _, _, size, _, _, _, _) in self.headers:
+            if not flags & SHF_ALLOC:
+                continue
+            if sh_type == SHT_NOBITS:
+                bss += size
+            elif flags & SHF_WRITE:
+                data += size
+            else:
+                text += size
+        return text, data, bss
+
+    def log_formats(self):
+        """Returns the number of LOG() format strings and their total size."""
+        if ".log_fmt" not in self.names:
+            return 0, 0
+        header = self.headers[self.names.index(".log_fmt")]
+        blob = self.data[header[4]:header[4] + header[5]]
+        return len([s for s in blob.split(b"\0") if s]), header[5]
+
+    def symbols(self):
+        """Returns {name: size} for every sized function and object."""
+        result = {}
+        for (_, sh_type, _, _, offset, size, link, _, _, entsize) in self.headers:
+            if sh_type != SHT_SYMTAB:
+                continue
+            strtab = self.headers[link][4]
+            for i in range(size // entsize):
+                name, _, sym_size, info, _, shndx = struct.unpack_from("<IIIBBH", self.data, offset + i * entsize)
+                if not sym_size or (info & 0xF) not in (STT_FUNC, STT_OBJECT):
+                    continue
+                if shndx >= len(self.headers) or not self.headers[shndx][2] & SHF_ALLOC:
+                    continue  # Undefined, absolute or debug-only symbol
+                key = self.string(strtab, name)
+                result[key] = result.get(key, 0) + sym_size
+        return result
+
+
+def print_totals(label, totals):
+    text, data, bss = totals
+    print("%-10s text %7d  data %6d  bss %6d  flash %7d  ram %6d" % (label, text, data, bss, text + data, data + bss))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", nargs="+", help="one ELF file, or a before and an after build")
+    parser.add_argument("--symbols", type=int, default=0, metavar="N", help="list the N largest (or most changed) symbols")
+    args = parser.parse_args()
+
+    if len(args.elf) > 2:
+        sys.exit("give one ELF file or two to compare")
+
+    elves = [Elf(path) for path in args.elf]
+    for label, elf in zip(("before", "after") if len(elves) == 2 else ("",), elves):
+        print("%-10s log_fmt %5d strings %6d bytes (not loaded)" % ((label,) + elf.log_formats()))
+
+    if len(elves) == 1:
+        print_totals("", elves[0].totals())
+        for name, size in sorted(elves[0].symbols().items(), key=lambda s: -s[1])[:args.symbols]:
+            print("  %7d  %s" % (size, name))
+        return
+
+    before, after = (e.totals() for e in elves)
+    print_totals("before", before)
+    print_totals("after", after)
+    print_totals("delta", tuple(a - b for a, b in zip(after, before)))
+
+    if args.symbols:
+        old, new = elves[0].symbols(), elves[1].symbols()
+        changes = [(new.get(n, 0) - old.get(n, 0), n) for n in set(old) | set(new)]
+        changes = [c for c in changes if c[0]]
+        for delta, name in sorted(changes, key=lambda c: -abs(c[0]))[:args.symbols]:
+            print("  %+7d  %s" % (delta, name))
+
+
+if __name__ == "__main__":
+    main()
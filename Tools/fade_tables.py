@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Generate the lookup tables of the fade engine (Core/Inc/fade.h).
+
+fade_gamma[]  257 points, brightness level -> PWM duty as a 0..65535 fraction
+              of the timer period. Level 0..999 is spread over 256 intervals
+              and fade_gamma_duty() interpolates between the points.
+fade_sine[]   65 points of the sine easing curve (1 - cos(pi * t)) / 2 for
+              t = 0..1, 0..65535.
+fade_breath[] 1024 TIM1 compare values of one breath (off, full, off along the
+              sine curve, through the gamma table) for a period of 16000
+              counts. pwm.c streams it into CCR4 by DMA.
+
+The default brightness curve is CIE 1931 lightness (L* -> luminance), which
+looks even to the eye over the whole range; --gamma uses a plain power law
+instead.
+
+Usage:
+    fade_tables.py -o Core/Src/fade_tables.c
+    fade_tables.py --gamma 2.2 -o Core/Src/fade_tables.c
+"""
+
+import argparse
+import math
+import sys
+
+GAMMA_POINTS = 256  # FADE_GAMMA_POINTS
+SINE_POINTS = 64    # FADE_SINE_POINTS
+BREATH_POINTS = 1024  # FADE_BREATH_POINTS
+BREATH_PERIOD = 16000  # FADE_BREATH_PERIOD, TIM1 ARR + 1 at 16 MHz and 1 kHz
+
+
+def cie_lightness(x):
+    """Luminance 0..1 for a perceived lightness 0..1."""
+    lightness = x * 100.0
+    if lightness <= 8.0:
+        return lightness / 903.3
+    return ((lightness + 16.0) / 116.0) ** 3
+
+
+def gamma_table(gamma):
+    curve = cie_lightness if gamma is None else (lambda x: x ** gamma)
+    table = [round(curve(i / GAMMA_POINTS) * 65535) for i in range(GAMMA_POINTS + 1)]
+    table[0] = 0
+    table[-1] = 65535
+    return table
+
+
+def sine_table():
+    return [min(65535, round((1.0 - math.cos(math.pi * i / SINE_POINTS)) / 2.0 * 65536)) for i in range(SINE_POINTS + 1)]
+
+
+def breath_table(gamma):
+    levels = [round((1.0 - math.cos(2.0 * math.pi * i / BREATH_POINTS)) / 2.0 * 999) for i in range(BREATH_POINTS)]
+    return [gamma_duty(gamma, level, BREATH_PERIOD) for level in levels]
+
+
+def gamma_duty(table, level, period):
+    """fade_gamma_duty() in Core/Inc/fade.h."""
+    if level >= 999:
+        return min(period, 0xFFFF)
+    pos = (level * 16794) >> 8
+    index, frac = pos >> 8, pos & 0xFF
+    duty = table[index] + (((table[index + 1] - table[index]) * frac) >> 8)
+    return (duty * period) >> 16
+
+
+def c_array(name, values, per_line=12):
+    lines = ["const uint16_t %s[%d] =" % (name, len(values)), "{"]
+    for i in range(0, len(values), per_line):
+        lines.append("\t" + " ".join("%5d," % v for v in values[i:i + per_line]))
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-o", "--output", help="C file to write, stdout when omitted")
+    parser.add_argument("--gamma", type=float, help="power-law exponent instead of CIE lightness")
+    args = parser.parse_args()
+
+    gamma = gamma_table(args.gamma)
+    curve = "CIE 1931 lightness" if args.gamma is None else "gamma %.2f" % args.gamma
+    source = "\n".join([
+        "// Generated by Tools/fade_tables.py, do not edit",
+        "",
+        "#include \"fade.h\"",
+        "",
+        "// Level 0..999 to duty, 0..65535 of the period, %s" % curve,
+        c_array("fade_gamma", gamma),
+        "",
+        "// (1 - cos(pi * t)) / 2, t = 0..1 in %d steps, 1.0 = 65535" % SINE_POINTS,
+        c_array("fade_sine", sine_table()),
+        "",
+        "// One breath for a period of %d counts, streamed into TIM1 CCR4" % BREATH_PERIOD,
+        c_array("fade_breath", breath_table(gamma)),
+        "",
+    ])
+
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(source)
+    else:
+        sys.stdout.write(source)
+
+    # Same arithmetic as fade_gamma_duty(), for a 1 kHz period at 16 MHz
+    period = 16000
+    duties = [gamma_duty(gamma, level, period) for level in range(1000)]
+    print("%s: %d distinct duties of %d counts for levels 0..999, lowest non-zero %d"
+          % (curve, len(set(duties)), period, min(d for d in duties if d)), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+"""Decode the tokenized USART2 log stream using the firmware ELF file.
+
+Frames written by LOG() and ISR_LOG() in Core/Inc/log.h look like
+
+    0xA5 | id (16-bit little endian) | one LEB128 varint per argument
+    0xA6 | timestamp (32-bit LE, microseconds) | id | args
+
+where id is the offset of the format string inside the non-loaded .log_fmt
+section. Timestamped frames are prefixed with the time in seconds so ISR
+records can be lined up with task messages. Binary telemetry frames (0xA7 up
+to the next 0x00, see Tools/telemetry_csv.py) are skipped. Any other byte is
+plain ASCII text and is passed through unchanged.
+
+Usage:
+    log_decode.py firmware.elf /dev/ttyACM0 [--baud 115200]
+    log_decode.py firmware.elf capture.bin
+    cat capture.bin | log_decode.py firmware.elf -
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+LOG_SYNC = 0xA5
+LOG_SYNC_TS = 0xA6
+TELEMETRY_SYNC = 0xA7
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diuxXcsp%])")
+
+
+class Elf:
+    """Minimal ELF32 little-endian section reader, enough for string lookups."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("%s is not a 32-bit little endian ELF file" % path)
+
+        (shoff,) = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x2E)
+
+        headers = []
+        for i in range(shnum):
+            headers.append(struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize))
+
+        strtab = headers[shstrndx][4]
+        self.sections = {}
+        self.loaded = []
+        for name, sh_type, flags, addr, offset, size, _, _, _, _ in headers:
+            end = self.data.index(b"\0", strtab + name)
+            section_name = self.data[strtab + name:end].decode()
+            self.sections[section_name] = (addr, offset, size)
+            if flags & SHF_ALLOC and sh_type != SHT_NOBITS:
+                self.loaded.append((addr, offset, size))
+
+    def section(self, name):
+        if name not in self.sections:
+            raise KeyError("section %s not found, is the ELF built with log.h?" % name)
+        return self.sections[name]
+
+    def string_at(self, offset):
+        end = self.data.index(b"\0", offset)
+        return self.data[offset:end].decode("utf-8", "replace")
+
+    def string_at_address(self, address):
+        for addr, offset, size in self.loaded:
+            if addr <= address < addr + size:
+                return self.string_at(offset + address - addr)
+        return "<0x%08x>" % address
+
+
+class Decoder:
+    def __init__(self, elf):
+        self.elf = elf
+        self.fmt_addr, self.fmt_offset, self.fmt_size = elf.section(".log_fmt")
+        self.formats = {}
+        self.epoch = 0
+        self.last_timestamp = None
+
+    def format_string(self, token):
+        if token not in self.formats:
+            if token >= self.fmt_size:
+                return None
+            self.formats[token] = self.elf.string_at(self.fmt_offset + token)
+        return self.formats[token]
+
+    def render(self, fmt, args):
+        values = iter(args)
+
+        def convert(match):
+            flags, _, kind = match.groups()
+            if kind == "%":
+                return "%"
+            value = next(values, 0)
+            if kind in "di":
+                value = value - (1 << 32) if value & 0x80000000 else value
+                return ("%" + flags + "d") % value
+            if kind == "c":
+                return chr(value & 0xFF)
+            if kind == "s":
+                return ("%" + flags + "s") % self.elf.string_at_address(value)
+            if kind == "p":
+                return "0x%08x" % value
+            return ("%" + flags + kind) % value
+
+        return CONVERSION.sub(convert, fmt)
+
+    @staticmethod
+    def argument_count(fmt):
+        return sum(1 for m in CONVERSION.finditer(fmt) if m.group(3) != "%")
+
+    def seconds(self, timestamp):
+        """Extends the 32-bit microsecond counter across wraps."""
+        if self.last_timestamp is not None and timestamp < self.last_timestamp - (1 << 31):
+            self.epoch += 1 << 32
+        self.last_timestamp = timestamp
+        return (self.epoch + timestamp) / 1e6
+
+    def decode(self, stream):
+        """Yields decoded text for every complete frame or text byte in stream."""
+        while True:
+            byte = stream.read(1)
+            if not byte:
+                return
+            if byte[0] == TELEMETRY_SYNC:
+                while byte and byte[0] != 0:
+                    byte = stream.read(1)
+                continue
+            if byte[0] not in (LOG_SYNC, LOG_SYNC_TS):
+                yield byte.decode("ascii", "replace")
+                continue
+
+            prefix = ""
+            if byte[0] == LOG_SYNC_TS:
+                raw = stream.read(4)
+                if len(raw) < 4:
+                    return
+                prefix = "[%12.6f] " % self.seconds(struct.unpack("<I", raw)[0])
+
+            header = stream.read(2)
+            if len(header) < 2:
+                return
+            token = header[0] | (header[1] << 8)
+            fmt = self.format_string(token)
+            if fmt is None:
+                yield "<unknown log id 0x%04x>\n" % token
+                continue
+
+            args = []
+            for _ in range(self.argument_count(fmt)):
+                value, shift = 0, 0
+                while True:
+                    b = stream.read(1)
+                    if not b:
+                        return
+                    value |= (b[0] & 0x7F) << shift
+                    shift += 7
+                    if not b[0] & 0x80:
+                        break
+                args.append(value & 0xFFFFFFFF)
+            yield prefix + self.render(fmt, args)
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        try:
+            import serial
+        except ImportError:
+            sys.exit("pyserial is required to read from %s (pip install pyserial)" % path)
+        return serial.Serial(path, baud)
+    return open(path, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF file the stream was produced by")
+    parser.add_argument("input", help="serial port, capture file, or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    decoder = Decoder(Elf(args.elf))
+    for text in decoder.decode(open_input(args.input, args.baud)):
+        sys.stdout.write(text)
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
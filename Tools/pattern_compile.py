@@ -0,0 +1,351 @@
+#!/usr/bin/env python3
+"""Compile an LED pattern script into the flash pattern blob.
+
+The script describes patterns for the pattern_vm interpreter
+(Core/Inc/pattern_vm.h):
+
+    # comment
+    pattern 0 green_blink
+        repeat 3
+            on green
+            wait 300
+            off green
+            wait 300
+        end
+    end
+
+Statements inside a pattern:
+
+    on <pin>[,<pin>...]         pins on, pins are green, red or pc0..pc15
+    off <pin>[,<pin>...]        pins off
+    pwm <level>                 blue PWM level, 0..999
+    wait <ms>                   hold the outputs
+    ramp <from> <to> <ms>       PWM ramp
+    levels <ms> <level>...      one PWM level per <ms>, e.g. a keyframed curve
+    repeat <n> ... end          repeat the block n times
+
+The compiler
+  - folds repeated runs of instructions into LOOP/NEXT (run-length encoding),
+  - writes a PWM level as a one-byte PWMD delta from the level before it when
+    that level is known at compile time (delta encoding),
+  - uses the one-byte WAITB for holds below 256 ms and merges adjacent waits.
+
+Blob layout, little endian (Core/Inc/patterns.h):
+
+    magic "PATB" | version u8 | vm_version u8 | count u16 | size u32
+    offset u16 * (count + 1)      ID i is bytes offset[i] .. offset[i+1]
+    pattern code ...
+
+The blob goes into the .patterns flash section (STM32G071R8TX_FLASH.ld), as a
+generated C file for the firmware build, or as a raw binary that can be
+programmed at that address on its own.
+
+Usage:
+    pattern_compile.py Patterns/default.pat -o Core/Src/pattern_blob.c
+    pattern_compile.py Patterns/default.pat --bin patterns.bin
+"""
+
+import argparse
+import struct
+import sys
+
+BLOB_MAGIC = b"PATB"
+BLOB_VERSION = 1
+VM_VERSION = 2            # PATTERN_VM_VERSION
+BLOB_CAPACITY = 4096      # LENGTH(PATTERNS) in the linker script
+HEADER_SIZE = 12
+
+MAX_DEPTH = 4             # PATTERN_VM_MAX_DEPTH
+PWM_MAX = 999             # PATTERN_VM_PWM_MAX
+MAX_FOLD_PERIOD = 16      # Longest run, in instructions, that is tried for folding
+
+OP_END, OP_SET, OP_CLEAR, OP_PWM, OP_WAIT, OP_LOOP, OP_NEXT, OP_RAMP, OP_PWMD, OP_WAITB = range(10)
+
+PINS = {"green": 10, "red": 12}
+
+
+class CompileError(Exception):
+    pass
+
+
+# --- Parsing ---------------------------------------------------------------
+
+def parse_int(text, low, high, line_no, what):
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise CompileError("line %d: %s '%s' is not a number" % (line_no, what, text))
+    if not low <= value <= high:
+        raise CompileError("line %d: %s %d is outside %d..%d" % (line_no, what, value, low, high))
+    return value
+
+
+def parse_pins(text, line_no):
+    mask = 0
+    for name in text.split(","):
+        name = name.strip().lower()
+        if name in PINS:
+            mask |= 1 << PINS[name]
+        elif name.startswith("pc") and name[2:].isdigit() and int(name[2:]) < 16:
+            mask |= 1 << int(name[2:])
+        elif name == "blue":
+            raise CompileError("line %d: blue is the PWM LED, use pwm/ramp/levels" % line_no)
+        else:
+            raise CompileError("line %d: unknown pin '%s'" % (line_no, name))
+    return mask
+
+
+def parse(lines):
+    """Returns a list of (id, name, body). A body is a list of statements:
+    ("set", mask) ("clear", mask) ("pwm", level) ("wait", ms)
+    ("ramp", from, to, ms) ("loop", count, body)."""
+    patterns = []
+    stack = None   # Open blocks of the current pattern, innermost last
+
+    for line_no, raw in enumerate(lines, 1):
+        words = raw.split("#", 1)[0].split()
+        if not words:
+            continue
+        keyword, args = words[0].lower(), words[1:]
+
+        if stack is None:
+            if keyword != "pattern" or len(args) not in (1, 2):
+                raise CompileError("line %d: expected 'pattern <id> [<name>]'" % line_no)
+            pattern_id = parse_int(args[0], 0, 255, line_no, "pattern id")
+            if any(p[0] == pattern_id for p in patterns):
+                raise CompileError("line %d: pattern %d defined twice" % (line_no, pattern_id))
+            body = []
+            patterns.append((pattern_id, args[1] if len(args) == 2 else "pattern%d" % pattern_id, body))
+            stack = [body]
+            continue
+
+        def expect(count):
+            if len(args) != count:
+                raise CompileError("line %d: '%s' takes %d argument(s)" % (line_no, keyword, count))
+
+        if keyword == "end":
+            expect(0)
+            stack.pop()
+            if not stack:
+                stack = None
+        elif keyword in ("on", "off"):
+            expect(1)
+            stack[-1].append(("set" if keyword == "on" else "clear", parse_pins(args[0], line_no)))
+        elif keyword == "pwm":
+            expect(1)
+            stack[-1].append(("pwm", parse_int(args[0], 0, PWM_MAX, line_no, "level")))
+        elif keyword == "wait":
+            expect(1)
+            stack[-1].append(("wait", parse_int(args[0], 0, 0x7FFFFFFF, line_no, "wait")))
+        elif keyword == "ramp":
+            expect(3)
+            stack[-1].append(("ramp", parse_int(args[0], 0, PWM_MAX, line_no, "level"),
+                              parse_int(args[1], 0, PWM_MAX, line_no, "level"),
+                              parse_int(args[2], 0, 0xFFFF, line_no, "ramp time")))
+        elif keyword == "levels":
+            if len(args) < 2:
+                raise CompileError("line %d: 'levels' takes a hold time and at least one level" % line_no)
+            hold = parse_int(args[0], 1, 0xFFFF, line_no, "hold")
+            for text in args[1:]:
+                stack[-1].append(("pwm", parse_int(text, 0, PWM_MAX, line_no, "level")))
+                stack[-1].append(("wait", hold))
+        elif keyword == "repeat":
+            expect(1)
+            body = []
+            stack[-1].append(("loop", parse_int(args[0], 1, 255, line_no, "repeat count"), body))
+            stack.append(body)
+        else:
+            raise CompileError("line %d: unknown statement '%s'" % (line_no, keyword))
+
+    if stack is not None:
+        raise CompileError("pattern %d is missing 'end'" % patterns[-1][0])
+    return patterns
+
+
+# --- Encoding --------------------------------------------------------------
+
+class Item:
+    """One encoded instruction, or a whole LOOP ... NEXT block."""
+
+    def __init__(self, code, duration, depth=0):
+        self.code = bytes(code)
+        self.duration = duration   # ms
+        self.depth = depth         # Loop levels inside this item
+
+    def __eq__(self, other):
+        return self.code == other.code
+
+    def __hash__(self):
+        return hash(self.code)
+
+
+def duration(body):
+    total = 0
+    for stmt in body:
+        if stmt[0] == "wait":
+            total += stmt[1]
+        elif stmt[0] == "ramp":
+            total += stmt[3]
+        elif stmt[0] == "loop":
+            total += stmt[1] * duration(stmt[2])
+    return total
+
+
+def loop_item(count, items):
+    inner = b"".join(i.code for i in items)
+    return Item(bytes([OP_LOOP, count]) + inner + bytes([OP_NEXT]),
+                count * sum(i.duration for i in items), 1 + max([i.depth for i in items] + [0]))
+
+
+def encode(body, level, depth, delta=True):
+    """Encodes a statement list. level is the PWM level on entry, or None when
+    it is not known at compile time. Returns (items, level on exit)."""
+    items = []
+    for stmt in body:
+        kind = stmt[0]
+        if kind == "set":
+            items.append(Item(struct.pack("<BH", OP_SET, stmt[1]), 0))
+        elif kind == "clear":
+            items.append(Item(struct.pack("<BH", OP_CLEAR, stmt[1]), 0))
+        elif kind == "pwm":
+            if delta and level is not None and stmt[1] == level:
+                continue
+            if delta and level is not None and -128 <= stmt[1] - level <= 127:
+                items.append(Item(struct.pack("<Bb", OP_PWMD, stmt[1] - level), 0))
+            else:
+                items.append(Item(struct.pack("<BH", OP_PWM, stmt[1]), 0))
+            level = stmt[1]
+        elif kind == "wait":
+            ms = stmt[1]
+            if delta and ms == 0:
+                continue
+            if delta and items and items[-1].code[0] in (OP_WAIT, OP_WAITB) and items[-1].depth == 0:
+                ms += items.pop().duration
+            while ms > 0xFFFF:
+                items.append(Item(struct.pack("<BH", OP_WAIT, 0xFFFF), 0xFFFF))
+                ms -= 0xFFFF
+            if delta and ms < 256:
+                items.append(Item(bytes([OP_WAITB, ms]), ms))
+            else:
+                items.append(Item(struct.pack("<BH", OP_WAIT, ms), ms))
+        elif kind == "ramp":
+            items.append(Item(struct.pack("<BHHH", OP_RAMP, stmt[1], stmt[2], stmt[3]), stmt[3]))
+            level = stmt[2]
+        elif kind == "loop":
+            count, inner = stmt[1], stmt[2]
+            if depth + 1 > MAX_DEPTH:
+                raise CompileError("repeat blocks nested deeper than %d" % MAX_DEPTH)
+            if duration(inner) == 0:
+                raise CompileError("a repeat block must take time (wait or ramp)")
+            # Deltas in the body are only valid if every pass starts at the same level
+            inner_items, exit_level = encode(inner, level, depth + 1, delta)
+            if exit_level != level:
+                inner_items, exit_level = encode(inner, None, depth + 1, delta)
+            items.append(loop_item(count, inner_items))
+            level = exit_level
+    if delta:
+        items = fold(items, depth)
+    return items, level
+
+
+def fold(items, depth):
+    """Run-length encoding: replaces back-to-back copies of an instruction run
+    by one LOOP block where that is shorter."""
+    out = []
+    i = 0
+    while i < len(items):
+        best = None
+        for period in range(1, min(MAX_FOLD_PERIOD, (len(items) - i) // 2) + 1):
+            body = items[i:i + period]
+            if sum(b.duration for b in body) == 0:
+                continue
+            if depth + 1 + max(b.depth for b in body) > MAX_DEPTH:
+                continue
+            count = 1
+            while count < 255 and items[i + count * period:i + (count + 1) * period] == body:
+                count += 1
+            saved = (count - 1) * sum(len(b.code) for b in body) - 3
+            if count > 1 and saved > 0 and (best is None or saved > best[0]):
+                best = (saved, period, count)
+        if best is None:
+            out.append(items[i])
+            i += 1
+        else:
+            _, period, count = best
+            out.append(loop_item(count, items[i:i + period]))
+            i += period * count
+    return out
+
+
+def compile_pattern(body):
+    items, _ = encode(body, None, 0)
+    return b"".join(i.code for i in items) + bytes([OP_END])
+
+
+def plain_size(body):
+    """Size without folding, deltas or short waits, for the report."""
+    items, _ = encode(body, None, 0, delta=False)
+    return sum(len(i.code) for i in items) + 1
+
+
+def build_blob(patterns):
+    count = max(p[0] for p in patterns) + 1 if patterns else 0
+    codes = {p[0]: compile_pattern(p[2]) for p in patterns}
+    offsets = []
+    position = HEADER_SIZE + 2 * (count + 1)
+    for pattern_id in range(count):
+        offsets.append(position)
+        position += len(codes.get(pattern_id, b""))
+    offsets.append(position)
+    if position > 0xFFFF:
+        raise CompileError("blob is %d bytes, offsets are 16-bit" % position)
+
+    blob = BLOB_MAGIC + struct.pack("<BBHI", BLOB_VERSION, VM_VERSION, count, position)
+    blob += struct.pack("<%dH" % len(offsets), *offsets)
+    blob += b"".join(codes.get(pattern_id, b"") for pattern_id in range(count))
+    return blob, codes, offsets[0]
+
+
+def write_c(path, blob, source):
+    with open(path, "w") as f:
+        f.write("// Generated by Tools/pattern_compile.py from %s, do not edit\n\n" % source)
+        f.write("#include <stdint.h>\n\n")
+        f.write("// Placed in the PATTERNS flash region, read through patterns.c\n")
+        f.write("__attribute__((section(\".patterns\"), used, aligned(4)))\n")
+        f.write("const uint8_t pattern_blob[%d] =\n{\n" % len(blob))
+        for i in range(0, len(blob), 12):
+            f.write("\t" + " ".join("0x%02X," % b for b in blob[i:i + 12]) + "\n")
+        f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("script", help="pattern script")
+    parser.add_argument("-o", "--output", help="generated C file")
+    parser.add_argument("--bin", help="raw blob for programming the .patterns region directly")
+    args = parser.parse_args()
+
+    try:
+        with open(args.script) as f:
+            patterns = parse(f.readlines())
+        blob, codes, index_end = build_blob(patterns)
+    except CompileError as e:
+        sys.exit("%s: %s" % (args.script, e))
+
+    print("%3s  %-20s %8s %8s %10s" % ("id", "name", "plain", "encoded", "duration"))
+    for pattern_id, name, body in sorted(patterns):
+        print("%3d  %-20s %7dB %7dB %8dms" % (pattern_id, name, plain_size(body), len(codes[pattern_id]), duration(body)))
+    print("blob %d bytes (header and index %d), %d of %d bytes of the PATTERNS region free"
+          % (len(blob), index_end, BLOB_CAPACITY - len(blob), BLOB_CAPACITY))
+    if len(blob) > BLOB_CAPACITY:
+        sys.exit("blob does not fit the PATTERNS region")
+
+    if args.output:
+        write_c(args.output, blob, args.script)
+    if args.bin:
+        with open(args.bin, "wb") as f:
+            f.write(blob)
+
+
+if __name__ == "__main__":
+    main()
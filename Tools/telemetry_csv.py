@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Convert the USART2 telemetry stream into CSV.
+
+Frames written by the Telemetry task (Core/Inc/telemetry.h) look like
+
+    0xA7 | COBS(type | seq | timestamp | body | crc32) | 0x00
+
+Schema records carry the comma separated variable names and become the CSV
+header, data records become one row each. Frames with a bad CRC, and all log
+and shell bytes between frames, are skipped. Start the stream from the shell
+with "telemetry 100".
+
+Usage:
+    telemetry_csv.py /dev/ttyACM0 [--baud 115200] > samples.csv
+    telemetry_csv.py capture.bin -o samples.csv
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+TELEMETRY_SYNC = 0xA7
+TELEMETRY_SCHEMA = 0x01
+TELEMETRY_DATA = 0x02
+MAX_FRAME = 256
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def check(encoded):
+    """Returns the record without its CRC, or None if the frame is damaged."""
+    record = cobs_decode(encoded)
+    if record is None or len(record) < 11:
+        return None
+    body, crc = record[:-4], struct.unpack("<I", record[-4:])[0]
+    return body if zlib.crc32(body) & 0xFFFFFFFF == crc else None
+
+
+def frames(stream):
+    """Yields the decoded record of every frame that passes the CRC check."""
+    while True:
+        byte = stream.read(1)
+        if not byte:
+            return
+        if byte[0] != TELEMETRY_SYNC:
+            continue
+
+        encoded = bytearray()
+        while len(encoded) <= MAX_FRAME:
+            b = stream.read(1)
+            if not b:
+                return
+            if b[0] == 0:
+                break
+            encoded += b
+
+        # A 0xA7 inside a log frame starts a bogus frame that swallows the real
+        # one, so retry from every later sync byte until the CRC matches
+        start = 0
+        while start is not None:
+            body = check(bytes(encoded[start:]))
+            if body is not None:
+                yield body
+                break
+            start = encoded.find(TELEMETRY_SYNC, start) + 1 or None
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        try:
+            import serial
+        except ImportError:
+            sys.exit("pyserial is required to read from %s (pip install pyserial)" % path)
+        return serial.Serial(path, baud)
+    return open(path, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port, capture file, or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("-o", "--output", help="CSV file, default stdout")
+    args = parser.parse_args()
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    names = None
+    last_seq = None
+    for record in frames(open_input(args.input, args.baud)):
+        kind, seq, timestamp = struct.unpack_from("<BHI", record)
+        body = record[7:]
+
+        if last_seq is not None and seq != (last_seq + 1) & 0xFFFF:
+            sys.stderr.write("lost %d records before seq %d\n" % ((seq - last_seq - 1) & 0xFFFF, seq))
+        last_seq = seq
+
+        if kind == TELEMETRY_SCHEMA:
+            schema = body.decode("ascii", "replace").split(",")
+            if schema != names:
+                names = schema
+                out.write("timestamp_us,seq," + ",".join(names) + "\n")
+        elif kind == TELEMETRY_DATA and names is not None:
+            values = struct.unpack("<%dI" % (len(body) // 4), body)
+            out.write("%d,%d,%s\n" % (timestamp, seq, ",".join(str(v) for v in values)))
+        out.flush()
+
+
+if __name__ == "__main__":
+    main()